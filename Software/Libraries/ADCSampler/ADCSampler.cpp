@@ -0,0 +1,150 @@
+#include <ADCSampler.h>
+#include <errno.h>
+
+#define ADCON1_ON       0x00008000
+#define ADCON1_SSRC_T3  0x00000040
+#define ADCON1_ASAM     0x00000004
+#define ADCON3_ADCS     0x00000003  // Tad of 8 PBCLK cycles
+#define TCON_ON         0x00008000
+
+static const uint16_t prescales[] = { 1, 2, 4, 8, 16, 32, 64, 256 };
+
+/*! Start sampling pin at rate samples a second.
+ *
+ *  oversample is a power of two up to ADC_BLOCK / 4. The rate read()
+ *  delivers is rate / oversample.
+ *
+ *  Returns false with errno set to EINVAL for a pin that has no analog
+ *  input or a rate or oversampling that cannot be had, or EBUSY if the
+ *  DMA channel is taken.
+ */
+bool ADCSampler::begin(uint8_t pin, uint32_t rate, uint8_t oversample) {
+    if ((pin >= NUM_DIGITAL_PINS) || (digitalPinToAnalog(pin) == NOT_ANALOG_PIN)) {
+        errno = EINVAL;
+        return false;
+    }
+
+    _shift = 0;
+    while ((1 << _shift) < oversample) {
+        _shift++;
+    }
+    if (((1 << _shift) != oversample) || (oversample > ADC_BLOCK / 4)) {
+        errno = EINVAL;
+        return false;
+    }
+
+    if ((rate == 0) || (rate > ADC_MAX_RATE)) {
+        errno = EINVAL;
+        return false;
+    }
+    uint32_t pbclk = getPeripheralClock();
+    uint8_t ps;
+    uint32_t ticks = 0;
+    for (ps = 0; ps < sizeof(prescales) / sizeof(prescales[0]); ps++) {
+        ticks = pbclk / ((uint32_t)prescales[ps] * rate);
+        if (ticks <= 65536) {
+            break;
+        }
+    }
+    if ((ticks < 2) || (ticks > 65536)) {
+        errno = EINVAL;
+        return false;
+    }
+
+    if (!_dma->begin()) {
+        errno = EBUSY;
+        return false;
+    }
+
+    pinMode(pin, INPUT);
+    p32_ioport *iop = (p32_ioport *)portRegisters(digitalPinToPort(pin));
+    iop->ansel.set = digitalPinToBitMask(pin);
+
+    T3CON = ps << 4;
+    TMR3 = 0;
+    PR3 = ticks - 1;
+
+    AD1CON1 = ADCON1_SSRC_T3 | ADCON1_ASAM;
+    AD1CON2 = 0;
+    AD1CON3 = ADCON3_ADCS;
+    AD1CHS = (uint32_t)analogInPinToChannel(digitalPinToAnalog(pin)) << 16;
+    AD1CSSL = 0;
+
+    _taken = 0;
+    _overruns = 0;
+    _dma->receiveContinuous(&ADC1BUF0, sizeof(uint16_t), _buf, sizeof(_buf), _ADC_IRQ);
+    AD1CON1SET = ADCON1_ON;
+    T3CONSET = TCON_ON;
+    return true;
+}
+
+void ADCSampler::end() {
+    T3CONCLR = TCON_ON;
+    AD1CON1CLR = ADCON1_ON;
+    _dma->abort();
+    _dma->end();
+}
+
+/*! A block is waiting to be read. */
+bool ADCSampler::available() {
+    return _dma->halves() > _taken;
+}
+
+/*! Pack the oldest waiting block into out, which must have room for
+ *  ADC_PACKED_MAX bytes.
+ *
+ *  If blocks have been missed since the last read they are counted as
+ *  overruns and the newest is read instead. A block that was overwritten
+ *  while it was being read is dropped the same way.
+ *
+ *  Returns the number of bytes written, 0 if there was nothing to read.
+ */
+size_t ADCSampler::read(uint8_t *out) {
+    uint32_t halves = _dma->halves();
+    if (halves <= _taken) {
+        return 0;
+    }
+    if (halves - _taken > 1) {
+        _overruns += halves - _taken - 1;
+        _taken = halves - 1;
+    }
+
+    const uint16_t *s = _buf + (_taken & 1) * ADC_BLOCK;
+    _taken++;
+
+    uint8_t *p = out;
+    int n = ADC_BLOCK >> _shift;
+    for (int i = 0; i < n; i += 4, p += 5) {
+        p[4] = 0;
+        for (int j = 0; j < 4; j++) {
+            uint32_t sum = 0;
+            for (int k = 0; k < (1 << _shift); k++) {
+                sum += *s++;
+            }
+            uint16_t v = sum >> _shift;
+            p[j] = v;
+            p[4] |= (v >> 8) << (j * 2);
+        }
+    }
+
+    // The channel has moved on into this half again
+    if (_dma->halves() > _taken) {
+        _overruns++;
+        return 0;
+    }
+    return p - out;
+}
+
+/*! Unpack len bytes of read() output back into samples.
+ *
+ *  Returns the number of samples.
+ */
+size_t ADCSampler::unpack(const uint8_t *in, size_t len, uint16_t *out) {
+    size_t n = 0;
+    for (size_t i = 0; i + 5 <= len; i += 5) {
+        for (int j = 0; j < 4; j++) {
+            out[n++] = in[i + j] | (((in[i + 4] >> (j * 2)) & 0x03) << 8);
+        }
+    }
+    return n;
+}
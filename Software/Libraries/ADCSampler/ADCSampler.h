@@ -0,0 +1,52 @@
+#ifndef _ADCSAMPLER_H
+#define _ADCSAMPLER_H
+
+#include <Arduino.h>
+#include <DMAChannel.h>
+
+// Samples in each half of the ping-pong buffer
+#define ADC_BLOCK 128
+#define ADC_MAX_RATE 100000
+
+// Largest block read() produces: four 10-bit samples in five bytes
+#define ADC_PACKED_MAX (ADC_BLOCK * 5 / 4)
+
+/*
+ * Timer driven acquisition from one analog pin.
+ *
+ * Timer3 ends each sample and starts the conversion, and a DMA channel
+ * moves every result into one half of a ping-pong buffer while the other
+ * half waits to be read, so nothing runs per sample. Every ADC_BLOCK
+ * samples the channel's interrupt wakes the CPU, which can stay in Idle
+ * in between. Sleep stops the timer.
+ *
+ * read() averages each run of oversample readings into one and packs the
+ * results four to five bytes:
+ *
+ *     byte 0-3   the low eight bits of samples 0 to 3
+ *     byte 4     their top two bits, sample 0 in bits 0-1
+ *
+ * The ADC and Timer3 must not be disabled with LowPower while running.
+ */
+class ADCSampler {
+    private:
+        DMAChannel *_dma;
+        uint16_t _buf[2 * ADC_BLOCK];
+        uint8_t _shift;         // log2 of the oversampling
+        uint32_t _taken;        // Halves read so far
+        uint32_t _overruns;
+
+    public:
+        ADCSampler(DMAChannel &dma) : _dma(&dma), _shift(0), _taken(0), _overruns(0) {}
+
+        bool begin(uint8_t pin, uint32_t rate, uint8_t oversample = 1);
+        void end();
+
+        bool available();
+        size_t read(uint8_t *out);
+        uint32_t overruns() { return _overruns; }
+
+        static size_t unpack(const uint8_t *in, size_t len, uint16_t *out);
+};
+
+#endif
@@ -0,0 +1,49 @@
+/*
+ * Samples the click AN pin at 4kHz, averages each four readings and
+ * streams the packed 1kHz result to whoever is connected over Bluetooth.
+ * The CPU idles between blocks.
+ *
+ * Needs the RN4871 already set up for the Transparent UART, as BLETest
+ * does.
+ */
+
+#include <DMAChannel.h>
+#include <ADCSampler.h>
+#include <RN4871.h>
+#include <LowPower.h>
+
+DMAChannel adcDMA(1);
+DMAChannel bleDMA(0);
+ADCSampler adc(adcDMA);
+RN4871 BLE(Serial1);
+
+uint8_t block[2][ADC_PACKED_MAX];
+int current = 0;
+
+void setup() {
+  pinMode(PIN_SENSOR_POWER, OUTPUT);
+  digitalWrite(PIN_SENSOR_POWER, HIGH);
+  pinMode(PIN_BLUETOOTH_POWER, OUTPUT);
+  digitalWrite(PIN_BLUETOOTH_POWER, HIGH);
+
+  Serial1.begin(115200);
+  BLE.waitForBoot(1000);
+  BLE.attachDMA(bleDMA, &U2TXREG, _UART2_TX_IRQ);
+
+  LowPower.enableADC();
+  LowPower.enableTimer3();
+  adc.begin(PIN_AN, 4000, 4);
+}
+
+void loop() {
+  while (!adc.available()) {
+    LowPower.enterIdleMode();
+  }
+
+  // The previous block may still be going out by DMA
+  size_t len = adc.read(block[current]);
+  if (len > 0) {
+    BLE.writeAsync(block[current], len);
+    current = !current;
+  }
+}
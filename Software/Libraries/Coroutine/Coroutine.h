@@ -0,0 +1,68 @@
+#ifndef _COROUTINE_H
+#define _COROUTINE_H
+
+#include <Arduino.h>
+
+/*
+ * Stackless coroutines in the style of protothreads.
+ *
+ * A coroutine is a function that returns false while it still has work
+ * to do and true once it has finished, and is called again and again
+ * until then. The CO_ macros let it be written as straight line code:
+ * each wait returns false and the next call carries on from that point.
+ *
+ * All that is kept between calls is the Coroutine object (a resume point
+ * and a timestamp), so any other state has to live in members or
+ * statics. Local variables do not survive a wait, and a coroutine body
+ * cannot contain a switch statement of its own.
+ *
+ *     bool Sensor::readTask(float &t) {
+ *         CO_BEGIN(_co);
+ *         startConversion();
+ *         CO_DELAY(_co, 10);
+ *         CO_WAIT_UNTIL(_co, conversionDone());
+ *         t = result();
+ *         CO_END(_co);
+ *     }
+ */
+class Coroutine {
+    public:
+        uint16_t _line;     // Where to resume, 0 when not started
+        uint32_t _since;    // Start of the current CO_DELAY
+
+        Coroutine() : _line(0), _since(0) {}
+
+        // Started and not yet finished
+        bool running() { return _line != 0; }
+        // Abandon the coroutine so the next call starts from the top
+        void reset() { _line = 0; }
+};
+
+// Resuming jumps to the case label inside each wait, and starting falls
+// straight through into it.
+#if defined(__GNUC__) && (__GNUC__ >= 7)
+#define CO_FALLTHROUGH __attribute__((fallthrough))
+#else
+#define CO_FALLTHROUGH
+#endif
+
+#define CO_BEGIN(c) switch ((c)._line) { case 0:
+
+#define CO_END(c) } (c)._line = 0; return true
+
+#define CO_YIELD(c) do { \
+    (c)._line = __LINE__; return false; case __LINE__:; \
+} while (0)
+
+#define CO_WAIT_UNTIL(c, cond) do { \
+    (c)._line = __LINE__; CO_FALLTHROUGH; case __LINE__: if (!(cond)) return false; \
+} while (0)
+
+#define CO_WAIT_WHILE(c, cond) CO_WAIT_UNTIL(c, !(cond))
+
+#define CO_DELAY(c, ms) do { \
+    (c)._since = millis(); \
+    CO_WAIT_UNTIL(c, millis() - (c)._since >= (ms)); \
+} while (0)
+
+#endif
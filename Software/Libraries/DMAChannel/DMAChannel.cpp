@@ -0,0 +1,155 @@
+#include <DMAChannel.h>
+#include <sys/kmem.h>
+
+#define DCH_CON_CHEN    0x00000080
+#define DCH_CON_CHAEN   0x00000010
+#define DCH_ECON_SIRQEN 0x00000010
+#define DCH_ECON_CFORCE 0x00000080
+#define DCH_INT_CHBCIF  0x00000008
+#define DCH_INT_CHDHIF  0x00000010
+#define DCH_INT_CHBCIE  0x00080000
+#define DCH_INT_CHDHIE  0x00100000
+#define DCH_INT_FLAGS   0x000000FF
+
+static DMAChannel *channels[DMA_CHANNELS] = { NULL };
+
+static const uint8_t dmaVector[DMA_CHANNELS] = {
+    _DMA_0_VECTOR, _DMA_1_VECTOR, _DMA_2_VECTOR, _DMA_3_VECTOR
+};
+
+static const uint8_t dmaIRQ[DMA_CHANNELS] = {
+    _DMA0_IRQ, _DMA1_IRQ, _DMA2_IRQ, _DMA3_IRQ
+};
+
+void __USER_ISR dma0ISR() { channels[0]->handleInterrupt(); }
+void __USER_ISR dma1ISR() { channels[1]->handleInterrupt(); }
+void __USER_ISR dma2ISR() { channels[2]->handleInterrupt(); }
+void __USER_ISR dma3ISR() { channels[3]->handleInterrupt(); }
+
+static isrFunc dmaISR[DMA_CHANNELS] = { dma0ISR, dma1ISR, dma2ISR, dma3ISR };
+
+/*! Claim the channel and install its completion interrupt.
+ *
+ *  Returns false if the channel does not exist or is already in use.
+ */
+bool DMAChannel::begin() {
+    if (_channel >= DMA_CHANNELS) {
+        return false;
+    }
+    if ((channels[_channel] != NULL) && (channels[_channel] != this)) {
+        return false;
+    }
+    channels[_channel] = this;
+    _regs = ((dmaRegs *)&DCH0CON) + _channel;
+    _busy = false;
+
+    DMACONSET = _DMACON_ON_MASK;
+    _regs->con.reg = 0;
+    _regs->econ.reg = 0;
+    _regs->intr.reg = DCH_INT_CHBCIE;
+
+    setIntVector(dmaVector[_channel], dmaISR[_channel]);
+    setIntPriority(dmaVector[_channel], 4, 0);
+    clearIntFlag(dmaIRQ[_channel]);
+    setIntEnable(dmaIRQ[_channel]);
+    return true;
+}
+
+void DMAChannel::end() {
+    if (_regs == NULL) {
+        return;
+    }
+    abort();
+    clearIntEnable(dmaIRQ[_channel]);
+    channels[_channel] = NULL;
+    _regs = NULL;
+}
+
+/*! Memory to peripheral transfer.
+ *
+ *  Moves len bytes from src into the single byte register dst, one byte
+ *  each time interrupt request irq fires. The source buffer must not be
+ *  touched until busy() returns false.
+ *
+ *  The peripheral is taken to be ready for the first byte (its transmit
+ *  buffer has room), so that one is forced: the request that said so has
+ *  already happened and would never come again.
+ */
+bool DMAChannel::transfer(const void *src, size_t len, volatile void *dst, uint8_t irq) {
+    if ((_regs == NULL) || _busy || (len == 0) || (len > 65535)) {
+        return false;
+    }
+    _regs->con.reg = 0;
+    _regs->ssa.reg = KVA_TO_PA(src);
+    _regs->dsa.reg = KVA_TO_PA(dst);
+    _regs->ssiz.reg = len;
+    _regs->dsiz.reg = 1;
+    _regs->csiz.reg = 1;
+    _regs->econ.reg = (irq << 8) | DCH_ECON_SIRQEN;
+    _regs->intr.clr = DCH_INT_FLAGS;
+    clearIntFlag(irq);
+    _busy = true;
+    _regs->con.set = DCH_CON_CHEN;
+    _regs->econ.set = DCH_ECON_CFORCE;
+    return true;
+}
+
+/*! Peripheral to memory transfer that runs until aborted.
+ *
+ *  Reads cells of size bytes (1, 2 or 4) from register src each time irq
+ *  fires, filling the len bytes at dst over and over. halves() counts
+ *  every time one half of dst has been filled, so one half can be worked
+ *  on while the channel fills the other.
+ */
+bool DMAChannel::receiveContinuous(volatile void *src, size_t size, void *dst, size_t len, uint8_t irq) {
+    if ((_regs == NULL) || _busy || (len == 0) || (len > 65535) || (len % (2 * size))) {
+        return false;
+    }
+    _regs->con.reg = 0;
+    _regs->ssa.reg = KVA_TO_PA(src);
+    _regs->dsa.reg = KVA_TO_PA(dst);
+    _regs->ssiz.reg = size;
+    _regs->dsiz.reg = len;
+    _regs->csiz.reg = size;
+    _regs->econ.reg = (irq << 8) | DCH_ECON_SIRQEN;
+    _regs->intr.clr = DCH_INT_FLAGS;
+    _regs->intr.set = DCH_INT_CHDHIE;
+    _halves = 0;
+    _continuous = true;
+    _busy = true;
+    _regs->con.set = DCH_CON_CHAEN | DCH_CON_CHEN;
+    return true;
+}
+
+void DMAChannel::abort() {
+    if (_regs == NULL) {
+        return;
+    }
+    _regs->con.clr = DCH_CON_CHAEN | DCH_CON_CHEN;
+    while (_regs->con.reg & DCH_CON_CHEN);
+    _regs->intr.clr = DCH_INT_FLAGS | DCH_INT_CHDHIE;
+    _continuous = false;
+    _busy = false;
+}
+
+void DMAChannel::handleInterrupt() {
+    uint32_t flags = _regs->intr.reg & DCH_INT_FLAGS;
+    _regs->intr.clr = DCH_INT_FLAGS;
+    clearIntFlag(dmaIRQ[_channel]);
+    if (_continuous) {
+        // Half full, or full and starting over. Both may be pending if
+        // the interrupt was held off.
+        uint32_t n = ((flags & DCH_INT_CHDHIF) ? 1 : 0) + ((flags & DCH_INT_CHBCIF) ? 1 : 0);
+        if (n > 0) {
+            _halves += n;
+            if (_callback != NULL) {
+                _callback();
+            }
+        }
+    } else if (flags & DCH_INT_CHBCIF) {
+        _busy = false;
+        if (_callback != NULL) {
+            _callback();
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#ifndef _DMACHANNEL_H
+#define _DMACHANNEL_H
+
+#include <Arduino.h>
+
+#define DMA_CHANNELS 4
+
+class DMAChannel {
+    private:
+        typedef struct {
+            volatile uint32_t reg;
+            volatile uint32_t clr;
+            volatile uint32_t set;
+            volatile uint32_t inv;
+        } dmaReg;
+
+        typedef struct {
+            dmaReg con;
+            dmaReg econ;
+            dmaReg intr;
+            dmaReg ssa;
+            dmaReg dsa;
+            dmaReg ssiz;
+            dmaReg dsiz;
+            dmaReg sptr;
+            dmaReg dptr;
+            dmaReg csiz;
+            dmaReg cptr;
+            dmaReg dat;
+        } dmaRegs;
+
+        uint8_t _channel;
+        dmaRegs *_regs;
+        volatile bool _busy;
+        bool _continuous;
+        volatile uint32_t _halves;
+        void (*_callback)();
+
+    public:
+        DMAChannel(uint8_t ch) : _channel(ch), _regs(NULL), _busy(false), _continuous(false), _halves(0), _callback(NULL) {}
+
+        bool begin();
+        void end();
+
+        bool transfer(const void *src, size_t len, volatile void *dst, uint8_t irq);
+        bool receiveContinuous(volatile void *src, size_t size, void *dst, size_t len, uint8_t irq);
+        uint32_t halves() { return _halves; }
+        size_t position() { return (_regs == NULL) ? 0 : _regs->dptr.reg; }
+        bool busy() { return _busy; }
+        void abort();
+
+        void attachInterrupt(void (*cb)()) { _callback = cb; }
+        void detachInterrupt() { _callback = NULL; }
+
+        void handleInterrupt();
+};
+
+#endif
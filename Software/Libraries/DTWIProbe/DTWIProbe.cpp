@@ -0,0 +1,35 @@
+#include <DTWIProbe.h>
+
+bool dtwiAcknowledges(DTWI *dtwi, uint8_t address, uint32_t timeout) {
+    uint8_t state = 0;
+    uint32_t ts = millis();
+    bool ack = false;
+    uint8_t b;
+    while (1) {
+        if (millis() - ts > timeout) {
+            dtwi->stopMaster();
+            return false;
+        }
+        switch (state) {
+            case 0: // Begin a one byte read
+                if (dtwi->startMasterRead(address, 1)) {
+                    state = 1;
+                }
+                break;
+            case 1: // Wait for the byte or the NACK
+                if (dtwi->available() > 0) {
+                    dtwi->read(&b, 1);
+                    ack = true;
+                    state = 2;
+                } else if (dtwi->getStatus().fNacking) {
+                    state = 2;
+                }
+                break;
+            case 2: // Stop Master
+                if (dtwi->stopMaster()) {
+                    return ack;
+                }
+                break;
+        }
+    }
+}
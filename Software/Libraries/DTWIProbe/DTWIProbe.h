@@ -0,0 +1,22 @@
+#ifndef _DTWIPROBE_H
+#define _DTWIPROBE_H
+
+#include <Arduino.h>
+#include <DTWI.h>
+
+// Longest a single probe may hold the bus, in ms
+#define DTWIPROBE_TIMEOUT   10
+
+/*
+ * Ask whether a chip answers at an I2C address.
+ *
+ * The probe reads one byte from the address. The chip only clocks a
+ * data byte out after it has acknowledged, so a received byte means
+ * it answered and a NACK in the bus status means it did not - either
+ * way we know as soon as the bus does, whatever its clock speed.
+ * Returns false if neither happens within timeout ms.
+ */
+
+bool dtwiAcknowledges(DTWI *dtwi, uint8_t address, uint32_t timeout = DTWIPROBE_TIMEOUT);
+
+#endif
@@ -1,4 +1,5 @@
 #include <EERAM_DTWI.h>
+#include <errno.h>
 
 uint8_t EERAM::read(uint16_t addr) {
     uint8_t state = 0;
@@ -169,49 +170,75 @@ void EERAM::write(uint16_t addr, uint8_t val) {
     }
 }
 
-void EERAM::write(uint16_t addr, uint8_t *data, size_t len) {
-    uint8_t state = 0;
-    uint32_t ts = millis();
-    uint8_t adata[2];
-    adata[0] = addr >> 8;
-    adata[1] = addr & 0xFF;
-    uint8_t *datap = data;
-    size_t towrite = len;
-    while (1) {
-        if (millis() - ts > 100) {
-            _dtwi->stopMaster();
+/*! Write a block, returning false with errno set to EBUSY if the bus
+ *  was stuck for EERAM_WRITE_TIMEOUT ms.
+ */
+bool EERAM::write(uint16_t addr, uint8_t *data, size_t len) {
+    while (!writeTask(addr, data, len));
+    return writeResult();
+}
+
+/*! Resumable block write.
+ *
+ *  Hands the address and data to the I2C master as fast as it will take
+ *  them and returns false while the transfer is still going, true once
+ *  the bus has been released. The data must stay put until then.
+ *  writeResult() and errno then say how it went, as for write().
+ */
+bool EERAM::writeTask(uint16_t addr, const uint8_t *data, size_t len) {
+    CO_BEGIN(_co);
+    _start = millis();
+    _addr[0] = addr >> 8;
+    _addr[1] = addr & 0xFF;
+    _addrDone = 0;
+    _done = 0;
+    CO_WAIT_UNTIL(_co, _dtwi->startMasterWrite(EERAM_SRAM_ADDRESS) || timedOut());
+    while ((_addrDone < 2) && !timedOut()) {
+        _addrDone += _dtwi->write(_addr + _addrDone, 2 - _addrDone);
+        if (_addrDone < 2) {
+            CO_YIELD(_co);
         }
-        switch (state) {
-            case 0: // begin write 
-                if (_dtwi->startMasterWrite(EERAM_SRAM_ADDRESS)) {
-                    state = 1;
-                }
-                break;
-            case 1: // Send register address
-                if (_dtwi->write(adata, 2) == 2) {
-                    state = 2;
-                }
-                break;
-            case 2: { 
-                    size_t nwritten = _dtwi->write(datap, min(towrite, 30));
-                    towrite -= nwritten;
-                    datap += nwritten;
-                    if (towrite == 0) {
-                        state = 3;
-                    }
-                }
-                break;
-            case 3: // Stop Master
-                if (_dtwi->stopMaster()) {
-                    return;
-                }
-                break;
+    }
+    while ((_done < len) && !timedOut()) {
+        _done += _dtwi->write((uint8_t *)data + _done, min(len - _done, 30));
+        if (_done < len) {
+            CO_YIELD(_co);
+        }
+    }
+    _result = (_addrDone == 2) && (_done == len);
+    CO_WAIT_UNTIL(_co, stop());
+    if (!_result) {
+        errno = EBUSY;
+    }
+    CO_END(_co);
+}
+
+// Release the bus, or give up on it once the write has run out of time
+bool EERAM::stop() {
+    if (_dtwi->stopMaster()) {
+        return true;
+    }
+    if (timedOut()) {
+        _result = false;
+        return true;
+    }
+    return false;
+}
+
+/*! Poll the chip until it acknowledges or timeout ms have passed. */
+bool EERAM::waitReady(uint32_t timeout) {
+    uint32_t ts = millis();
+    while (millis() - ts < timeout) {
+        if (dtwiAcknowledges(_dtwi, EERAM_CONTROL_ADDRESS)) {
+            return true;
         }
     }
+    return false;
 }
 
 void EERAM::begin() {
     _dtwi->beginMaster();
+    waitReady(EERAM_READY_TIMEOUT);
     writeConfig(0b00000010); // Enable ASE
 }
 
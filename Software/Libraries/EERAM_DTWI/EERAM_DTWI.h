@@ -3,27 +3,49 @@
 
 #include <Arduino.h>
 #include <DTWI.h>
+#include <DTWIProbe.h>
+#include <Coroutine.h>
 
 #define EERAM_SRAM_ADDRESS      0x50
 #define EERAM_CONTROL_ADDRESS   0x18
 
+// Longest we will wait for the chip to answer after power is applied.
+// The power-up recall from EEPROM finishes well inside this.
+#define EERAM_READY_TIMEOUT     50
+
+// Longest a block write may take before the bus is taken to be stuck
+#define EERAM_WRITE_TIMEOUT     100
+
 class EERAM {
     private:
         DTWI *_dtwi;
 
         void writeConfig(uint8_t val);
 
+        Coroutine _co;
+        uint8_t _addr[2];
+        size_t _addrDone;
+        size_t _done;
+        uint32_t _start;
+        bool _result;
+
+        bool timedOut() { return millis() - _start > EERAM_WRITE_TIMEOUT; }
+        bool stop();
+
     public:
 
-        EERAM(DTWI *d) : _dtwi(d) {}
-        EERAM(DTWI &d) : _dtwi(&d) {}
+        EERAM(DTWI *d) : _dtwi(d), _addrDone(0), _done(0), _start(0), _result(false) {}
+        EERAM(DTWI &d) : _dtwi(&d), _addrDone(0), _done(0), _start(0), _result(false) {}
         
         void begin();
         void end();
+        bool waitReady(uint32_t timeout);
         uint8_t read(uint16_t addr);
         size_t read(uint16_t addr, uint8_t *data, size_t len);
         void write(uint16_t addr, uint8_t v);
-        void write(uint16_t addr, uint8_t *data, size_t len);
+        bool write(uint16_t addr, uint8_t *data, size_t len);
+        bool writeTask(uint16_t addr, const uint8_t *data, size_t len);
+        bool writeResult() { return _result; }
 };
 
 #endif
@@ -1,4 +1,5 @@
 #include <DTWI.h>
+#include <DTWIProbe.h>
 #include <EERAM_DTWI.h>
 
 DTWI0 dtwi;
@@ -36,8 +37,14 @@ void loop() {
   
   Serial.print("Restoring power...");
   digitalWrite(PIN_SENSOR_POWER, HIGH);
-  delay(1000);
-  Serial.println("done");
+  uint32_t ts = millis();
+  if (eeram.waitReady(1000)) {
+    Serial.print("ready after ");
+    Serial.print(millis() - ts);
+    Serial.println("ms");
+  } else {
+    Serial.println("no answer");
+  }
   
   
   Serial.print("Bytewise Reading...");
@@ -77,8 +77,20 @@ void EMC1001::writeRegister(uint8_t reg, uint8_t val) {
     }
 }
 
+/*! Poll the chip until it acknowledges or timeout ms have passed. */
+bool EMC1001::waitReady(uint32_t timeout) {
+    uint32_t ts = millis();
+    while (millis() - ts < timeout) {
+        if (dtwiAcknowledges(_dtwi, _address)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 void EMC1001::begin() {
     _dtwi->beginMaster();
+    waitReady(EMC1001_READY_TIMEOUT);
     writeRegister(EMC1001_CONFIG, 0b000010); // Standby mode
 }
 
@@ -87,15 +99,30 @@ void EMC1001::end() {
 }
 
 float EMC1001::getTemperature() {
+    float t;
+    while (!temperatureTask(t));
+    return t;
+}
+
+/*! Resumable one-shot temperature reading.
+ *
+ *  Returns false until the conversion has finished, then stores the
+ *  result in t and returns true. Between calls the sensor is converting
+ *  and the CPU is free for other work.
+ */
+bool EMC1001::temperatureTask(float &t) {
+    CO_BEGIN(_co);
     writeRegister(EMC1001_ONE_SHOT, 1);
-    uint8_t status = readRegister(EMC1001_STATUS);
-    while (status & EMC1001_STATUS_BUSY) {
-        status = readRegister(EMC1001_STATUS);
-    }
-    uint8_t h = readRegister(EMC1001_TEMP_HIGH);
-    uint8_t l = readRegister(EMC1001_TEMP_LOW);
-    uint16_t v = (h << 8) | l;
-    v >>= 6;
-    v |= (v & 0b0000001000000000) ? 0b1111110000000000 : 0;
-    return (float)v * 0.25;
+    do {
+        CO_DELAY(_co, EMC1001_POLL_INTERVAL);
+    } while (readRegister(EMC1001_STATUS) & EMC1001_STATUS_BUSY);
+    t = toCelsius(readRegister(EMC1001_TEMP_HIGH), readRegister(EMC1001_TEMP_LOW));
+    CO_END(_co);
+}
+
+// The reading is a 10 bit two's complement number of quarter degrees,
+// left aligned across the two registers.
+float EMC1001::toCelsius(uint8_t high, uint8_t low) {
+    int16_t v = (int16_t)((high << 8) | low);
+    return (float)(v >> 6) * 0.25;
 }
@@ -3,6 +3,8 @@
 
 #include <Arduino.h>
 #include <DTWI.h>
+#include <DTWIProbe.h>
+#include <Coroutine.h>
 
 #define EMC1001_ADDRESS 0x38
 #define EMC1001_TEMP_HIGH       0x00
@@ -27,6 +29,12 @@
 #define EMC1001_STATUS_THIGH    0b01000000
 #define EMC1001_STATUS_BUSY     0b10000000
 
+// Longest we will wait for the sensor to answer after power is applied
+#define EMC1001_READY_TIMEOUT   50
+
+// How often to ask whether a conversion has finished, in ms
+#define EMC1001_POLL_INTERVAL   5
+
 class EMC1001 {
     private:
         DTWI *_dtwi;
@@ -35,6 +43,9 @@ class EMC1001 {
         uint8_t readRegister(uint8_t reg);
         void writeRegister(uint8_t reg, uint8_t val);
 
+        Coroutine _co;
+        static float toCelsius(uint8_t high, uint8_t low);
+
 
     public:
 
@@ -45,7 +56,9 @@ class EMC1001 {
         
         void begin();
         void end();
+        bool waitReady(uint32_t timeout);
         float getTemperature();
+        bool temperatureTask(float &t);
 };
 
 #endif
@@ -1,4 +1,5 @@
 #include <DTWI.h>
+#include <DTWIProbe.h>
 #include <EMC1001_DTWI.h>
 
 DTWI0 dtwi;
@@ -0,0 +1,76 @@
+#include <EventQueue.h>
+
+EventQueue::EventQueue() : _sequence(0), _lost(0) {
+    for (int i = 0; i < EVENTQUEUE_SOURCES; i++) {
+        _rings[i].head = 0;
+        _rings[i].tail = 0;
+    }
+}
+
+/*! Post an event. Only ever call for one source from one interrupt.
+ *
+ *  Returns false if the source's ring is full and the event was dropped.
+ */
+bool EventQueue::post(uint8_t source, uint8_t data) {
+    if (source >= EVENTQUEUE_SOURCES) {
+        return false;
+    }
+    ring &r = _rings[source];
+    uint8_t next = (r.head + 1) % EVENTQUEUE_DEPTH;
+    if (next == r.tail) {
+        __sync_fetch_and_add(&_lost, 1);
+        return false;
+    }
+    Event &e = r.events[r.head];
+    e.sequence = __sync_fetch_and_add(&_sequence, 1);
+    e.time = RTCTIME;
+    e.ms = millis();
+    e.source = source;
+    e.data = data;
+    // The event must be complete before the main loop can see it
+    __sync_synchronize();
+    r.head = next;
+    return true;
+}
+
+/*! Take the oldest waiting event from any source. */
+bool EventQueue::get(Event &e) {
+    int oldest = -1;
+    for (int i = 0; i < EVENTQUEUE_SOURCES; i++) {
+        ring &r = _rings[i];
+        if (r.tail == r.head) {
+            continue;
+        }
+        if ((oldest < 0) || ((int32_t)(r.events[r.tail].sequence - _rings[oldest].events[_rings[oldest].tail].sequence) < 0)) {
+            oldest = i;
+        }
+    }
+    if (oldest < 0) {
+        return false;
+    }
+    ring &r = _rings[oldest];
+    e = r.events[r.tail];
+    // Done with the slot before the source may reuse it
+    __sync_synchronize();
+    r.tail = (r.tail + 1) % EVENTQUEUE_DEPTH;
+    return true;
+}
+
+bool EventQueue::empty() {
+    for (int i = 0; i < EVENTQUEUE_SOURCES; i++) {
+        if (_rings[i].tail != _rings[i].head) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*! Convert an event time (BCD hours, minutes and seconds from RTCTIME)
+ *  into seconds since midnight.
+ */
+uint32_t EventQueue::timeOfDay(uint32_t time) {
+    uint32_t h = ((time >> 28) & 0x0F) * 10 + ((time >> 24) & 0x0F);
+    uint32_t m = ((time >> 20) & 0x0F) * 10 + ((time >> 16) & 0x0F);
+    uint32_t s = ((time >> 12) & 0x0F) * 10 + ((time >> 8) & 0x0F);
+    return (h * 60 + m) * 60 + s;
+}
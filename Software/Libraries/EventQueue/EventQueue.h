@@ -0,0 +1,56 @@
+#ifndef _EVENTQUEUE_H
+#define _EVENTQUEUE_H
+
+#include <Arduino.h>
+
+// Interrupt sources, and events each can have waiting
+#define EVENTQUEUE_SOURCES 4
+#define EVENTQUEUE_DEPTH 8
+
+/*
+ * Queue of events from interrupt handlers to the main loop.
+ *
+ * Each source (one interrupt handler) has its own ring with a single
+ * producer and the main loop as the single consumer, so posting needs
+ * no locks and never waits. Events carry a sequence number, taken
+ * atomically across all sources, and the RTCC time and millis() they
+ * happened at. get() hands them out in the order they were posted.
+ * millis() stops in Sleep, so only compare it between events from the
+ * same stretch awake.
+ *
+ * If a source posts faster than the main loop drains it, new events for
+ * that source are dropped and counted by lost().
+ */
+class EventQueue {
+    public:
+        typedef struct {
+            uint32_t sequence;
+            uint32_t time;      // RTCTIME when posted
+            uint32_t ms;        // millis() when posted
+            uint8_t source;
+            uint8_t data;
+        } Event;
+
+    private:
+        typedef struct {
+            Event events[EVENTQUEUE_DEPTH];
+            volatile uint8_t head;  // Written only by the source
+            volatile uint8_t tail;  // Written only by the main loop
+        } ring;
+
+        ring _rings[EVENTQUEUE_SOURCES];
+        volatile uint32_t _sequence;
+        volatile uint32_t _lost;
+
+    public:
+        EventQueue();
+
+        bool post(uint8_t source, uint8_t data = 0);
+        bool get(Event &e);
+        bool empty();
+        uint32_t lost() { return _lost; }
+
+        static uint32_t timeOfDay(uint32_t time);
+};
+
+#endif
@@ -0,0 +1,104 @@
+#include <Format.h>
+
+/*! Write v in decimal, zero padded to at least digits digits. */
+char *formatUnsigned(char *p, uint32_t v, int digits) {
+    char tmp[10];
+    int n = 0;
+
+    do {
+        tmp[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while ((n < digits) && (n < (int)sizeof(tmp))) {
+        tmp[n++] = '0';
+    }
+    while (n) {
+        *p++ = tmp[--n];
+    }
+    *p = 0;
+    return p;
+}
+
+/*! Write a fixed point number, v being the value times 10^decimals.
+ *
+ *  There is always a digit before the point. The result is right aligned
+ *  with spaces to at least width characters, so 2325 with two decimals
+ *  gives "23.25" and -50 gives "-0.50". More than FORMAT_MAX_DECIMALS
+ *  decimals writes nothing.
+ */
+char *formatFixed(char *p, int32_t v, int decimals, int width) {
+    char tmp[12]; // Sign, point and the ten digits of a uint32_t
+    int n = 0;
+    uint32_t u = (v < 0) ? -(uint32_t)v : v;
+
+    *p = 0;
+    if ((decimals < 0) || (decimals > FORMAT_MAX_DECIMALS)) {
+        return p;
+    }
+
+    do {
+        tmp[n++] = '0' + u % 10;
+        u /= 10;
+        if (n == decimals) {
+            tmp[n++] = '.';
+        }
+    } while (u || (decimals && (n <= decimals + 1)));
+    if (v < 0) {
+        tmp[n++] = '-';
+    }
+    for (int i = n; i < width; i++) {
+        *p++ = ' ';
+    }
+    while (n) {
+        *p++ = tmp[--n];
+    }
+    *p = 0;
+    return p;
+}
+
+/*! Write v as exactly digits upper case hex digits. */
+char *formatHex(char *p, uint32_t v, int digits) {
+    for (int i = digits - 1; i >= 0; i--) {
+        p[i] = "0123456789ABCDEF"[v & 0x0F];
+        v >>= 4;
+    }
+    p[digits] = 0;
+    return p + digits;
+}
+
+/*! Write the time held in an RTCTIME value as hh:mm:ss.
+ *
+ *  The register keeps the time as BCD, so the digits are read straight
+ *  out of it.
+ */
+char *formatTime(char *p, uint32_t rtctime) {
+    for (int shift = 24; shift >= 8; shift -= 8) {
+        uint8_t b = rtctime >> shift;
+        *p++ = '0' + (b >> 4);
+        *p++ = '0' + (b & 0x0F);
+        if (shift > 8) {
+            *p++ = ':';
+        }
+    }
+    *p = 0;
+    return p;
+}
+
+/*! Read a hex number that fills the whole string, in either case. */
+bool parseHex(const char *p, uint32_t &v) {
+    v = 0;
+    if (*p == 0) {
+        return false;
+    }
+    for (; *p; p++) {
+        char c = *p | 0x20;
+        if ((c >= '0') && (c <= '9')) {
+            v = (v << 4) | (c - '0');
+        } else if ((c >= 'a') && (c <= 'f')) {
+            v = (v << 4) | (c - 'a' + 10);
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,28 @@
+#ifndef _FORMAT_H
+#define _FORMAT_H
+
+#include <Arduino.h>
+
+// A uint32_t has ten digits, so more decimals than this mean nothing
+#define FORMAT_MAX_DECIMALS 9
+
+/*
+ * Number formatting for readouts and protocol fields without printf.
+ *
+ * Each function writes into the buffer at p, terminates it and returns
+ * the end of what it wrote, so fields can be chained:
+ *
+ *     char *p = formatFixed(buf, 2325, 2, 4);   // "23.25"
+ *     *p++ = ' ';
+ *     formatTime(p, RTCTIME);                   // "23.25 12:34:56"
+ *
+ * The caller makes sure the buffer is big enough.
+ */
+
+char *formatUnsigned(char *p, uint32_t v, int digits = 1);
+char *formatFixed(char *p, int32_t v, int decimals, int width = 0);
+char *formatHex(char *p, uint32_t v, int digits);
+char *formatTime(char *p, uint32_t rtctime);
+bool parseHex(const char *p, uint32_t &v);
+
+#endif
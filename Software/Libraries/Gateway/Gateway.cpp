@@ -0,0 +1,147 @@
+#include <Gateway.h>
+#include <errno.h>
+
+/*! Collect new samples from every peer in range.
+ *
+ *  Scans for scanTime ms, then connects to each unit found in turn and
+ *  adds whatever samples it has that are not yet in the log. The module
+ *  must be powered, booted, not connected and in data mode, and is left
+ *  in data mode. Returns the number of new samples stored, or -1 if the
+ *  scan could not be started.
+ */
+int Gateway::collect(uint32_t scanTime) {
+    char found[PEERLOG_PEERS][13];
+    int nfound = 0;
+
+    _ble->enterCommandMode();
+    if (!_ble->startScan()) {
+        _ble->enterDataMode();
+        return -1;
+    }
+
+    RN4871::ScanResult r;
+    uint32_t ts = millis();
+    while ((millis() - ts < scanTime) && (nfound < PEERLOG_PEERS)) {
+        if (!_ble->readScanResult(r, scanTime - (millis() - ts))) {
+            break;
+        }
+        if (strncmp(r.name, GATEWAY_PEER_NAME, strlen(GATEWAY_PEER_NAME))) {
+            continue;
+        }
+        bool seen = false;
+        for (int i = 0; i < nfound; i++) {
+            if (!strcmp(found[i], r.address)) {
+                seen = true;
+            }
+        }
+        if (!seen) {
+            strcpy(found[nfound++], r.address);
+        }
+    }
+    _ble->stopScan();
+
+    int total = 0;
+    for (int i = 0; i < nfound; i++) {
+        int n = pull(found[i]);
+        if (n > 0) {
+            total += n;
+        }
+    }
+    _ble->enterDataMode();
+    return total;
+}
+
+/*! Connect to one peer, fetch its new samples and disconnect again.
+ *
+ *  Returns the number of samples stored, or -1 with errno set if the
+ *  peer could not be reached or stopped answering.
+ */
+int Gateway::pull(const char *address) {
+    int peer = _log->add(address);
+    if (peer < 0) {
+        return -1;
+    }
+
+    if (!_ble->connect(address) || !_ble->waitForStatus("CONNECT", GATEWAY_LINK_TIMEOUT)) {
+        return -1;
+    }
+
+    int n = -1;
+    if (_ble->startClient() && _ble->waitForStatus("STREAM_OPEN", GATEWAY_LINK_TIMEOUT)) {
+        _ble->enterDataMode();
+        n = fetch(peer);
+        _ble->enterCommandMode();
+    }
+
+    int err = errno;
+    _ble->disconnect();
+    _ble->waitForStatus("DISCONNECT", GATEWAY_LINK_TIMEOUT);
+    errno = err;
+    return n;
+}
+
+/*! Ask a connected peer for its history and store the new part of it. */
+int Gateway::fetch(int peer) {
+    // A peer that is already awake treats the wake byte as noise and
+    // never answers it, which is fine.
+    _ble->write((uint8_t)GATEWAY_WAKE);
+    waitReady();
+
+    _ble->write((uint8_t)GATEWAY_HISTORY);
+
+    uint8_t header[6];
+    if (!readBytes(header, sizeof(header), GATEWAY_READ_TIMEOUT)) {
+        return -1;
+    }
+    uint32_t total = header[0] | (header[1] << 8) | ((uint32_t)header[2] << 16) | ((uint32_t)header[3] << 24);
+    uint16_t count = header[4] | (header[5] << 8);
+    if ((count > GATEWAY_MAX_SAMPLES) || (count > total)) {
+        errno = ENOMSG;
+        return -1;
+    }
+
+    int stored = 0;
+    uint32_t last = _log->lastSequence(peer);
+    for (uint16_t i = 0; i < count; i++) {
+        float t;
+        if (!readBytes((uint8_t *)&t, sizeof(t), GATEWAY_READ_TIMEOUT)) {
+            return -1;
+        }
+        uint32_t sequence = total - count + 1 + i;
+        if (sequence > last) {
+            _log->store(peer, sequence, t);
+            stored++;
+        }
+    }
+    return stored;
+}
+
+// Wait for the peer to say it is listening. Nothing else should arrive
+// before it, so anything else is dropped.
+bool Gateway::waitReady() {
+    uint32_t ts = millis();
+    while (millis() - ts < GATEWAY_READY_TIMEOUT) {
+        int c = _ble->read();
+        if (c == GATEWAY_READY) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Gateway::readBytes(uint8_t *buf, size_t len, uint32_t timeout) {
+    size_t pos = 0;
+    uint32_t ts = millis();
+    while (pos < len) {
+        if (millis() - ts >= timeout) {
+            errno = EBUSY;
+            return false;
+        }
+        int c = _ble->read();
+        if (c >= 0) {
+            buf[pos++] = c;
+            ts = millis();
+        }
+    }
+    return true;
+}
@@ -0,0 +1,54 @@
+#ifndef _GATEWAY_H
+#define _GATEWAY_H
+
+#include <Arduino.h>
+#include <RN4871.h>
+#include <PeerLog.h>
+
+// Units to collect from advertise with a name starting with this
+#define GATEWAY_PEER_NAME "DSMini"
+
+// Time allowed for each step of talking to a peer, in ms
+#define GATEWAY_LINK_TIMEOUT 3000
+#define GATEWAY_READY_TIMEOUT 500
+#define GATEWAY_READ_TIMEOUT 2000
+
+/* The peer protocol, as spoken over the Transparent UART service.
+ *
+ * Waking: a sleeping peer is woken by the start bit of the first byte
+ * it receives, while its UART is unclocked, so that byte and anything
+ * else sent while its clock comes back are lost. The gateway therefore
+ * sends a single GATEWAY_WAKE, sends nothing more until GATEWAY_READY
+ * comes back, and gives up after GATEWAY_READY_TIMEOUT. The peer sends
+ * GATEWAY_READY once per wake, however many edges the wake byte had,
+ * and keeps everything that arrives after it. A peer that was already
+ * awake ignores GATEWAY_WAKE and sends nothing, so the wait just times
+ * out.
+ *
+ * The gateway then sends GATEWAY_HISTORY and the peer replies with the total
+ * number of samples it has ever taken (32 bits), the number of samples
+ * that follow (16 bits) and then those samples as floats, oldest first.
+ * Everything is little endian.
+ */
+#define GATEWAY_WAKE 0x00
+#define GATEWAY_READY 0x11
+#define GATEWAY_HISTORY 'H'
+#define GATEWAY_MAX_SAMPLES 96
+
+class Gateway {
+    private:
+        RN4871 *_ble;
+        PeerLog *_log;
+
+        bool readBytes(uint8_t *buf, size_t len, uint32_t timeout);
+        bool waitReady();
+        int pull(const char *address);
+        int fetch(int peer);
+
+    public:
+        Gateway(RN4871 &ble, PeerLog &log) : _ble(&ble), _log(&log) {}
+
+        int collect(uint32_t scanTime);
+};
+
+#endif
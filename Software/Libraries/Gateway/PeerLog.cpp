@@ -0,0 +1,112 @@
+#include <PeerLog.h>
+#include <errno.h>
+
+void PeerLog::clear() {
+    memset(&_data, 0, sizeof(_data));
+}
+
+/*! Check a log loaded from memory.
+ *
+ *  Anything inconsistent, such as the contents of memory that has never
+ *  held a log, clears it. Returns false if that happened.
+ */
+bool PeerLog::validate() {
+    bool ok = (_data.head < PEERLOG_RECORDS) && (_data.count <= PEERLOG_RECORDS);
+    for (int i = 0; ok && (i < PEERLOG_PEERS); i++) {
+        ok = (memchr(_data.peers[i].address, 0, sizeof(_data.peers[i].address)) != NULL);
+    }
+    for (size_t i = 0; ok && (i < _data.count); i++) {
+        ok = (_data.records[i].peer < PEERLOG_PEERS);
+    }
+    if (!ok) {
+        clear();
+    }
+    return ok;
+}
+
+/*! Look up a peer by address. Returns -1 if it is not known. */
+int PeerLog::find(const char *address) {
+    for (int i = 0; i < PEERLOG_PEERS; i++) {
+        if (!strcmp(_data.peers[i].address, address)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/*! Look up a peer, adding it if it is new.
+ *
+ *  Returns -1 with errno set to ENOSPC if the peer table is full, or
+ *  EINVAL if the address is not a 12 digit Bluetooth address.
+ */
+int PeerLog::add(const char *address) {
+    if (strlen(address) != 12) {
+        errno = EINVAL;
+        return -1;
+    }
+    int peer = find(address);
+    if (peer >= 0) {
+        return peer;
+    }
+    for (int i = 0; i < PEERLOG_PEERS; i++) {
+        if (_data.peers[i].address[0] == 0) {
+            strcpy(_data.peers[i].address, address);
+            _data.peers[i].lastSequence = 0;
+            return i;
+        }
+    }
+    errno = ENOSPC;
+    return -1;
+}
+
+const char *PeerLog::address(int peer) {
+    if ((peer < 0) || (peer >= PEERLOG_PEERS)) {
+        return NULL;
+    }
+    return _data.peers[peer].address;
+}
+
+/*! The number of the newest sample stored for a peer, 0 if none. */
+uint32_t PeerLog::lastSequence(int peer) {
+    if ((peer < 0) || (peer >= PEERLOG_PEERS)) {
+        return 0;
+    }
+    return _data.peers[peer].lastSequence;
+}
+
+/*! Add a sample from a peer.
+ *
+ *  Samples numbered at or below the last one stored for that peer have
+ *  been seen before and are ignored.
+ */
+void PeerLog::store(int peer, uint32_t sequence, float temperature) {
+    if ((peer < 0) || (peer >= PEERLOG_PEERS)) {
+        return;
+    }
+    if (sequence <= _data.peers[peer].lastSequence) {
+        return;
+    }
+    _data.peers[peer].lastSequence = sequence;
+
+    recordEntry &r = _data.records[_data.head];
+    r.peer = peer;
+    r.sequence = sequence;
+    r.temperature = (int16_t)(temperature * 100.0 + (temperature < 0 ? -0.5 : 0.5));
+
+    _data.head = (_data.head + 1) % PEERLOG_RECORDS;
+    if (_data.count < PEERLOG_RECORDS) {
+        _data.count++;
+    }
+}
+
+/*! Fetch a record. 0 is the oldest still held. */
+bool PeerLog::get(size_t i, int &peer, uint32_t &sequence, float &temperature) {
+    if (i >= _data.count) {
+        return false;
+    }
+    recordEntry &r = _data.records[(_data.head + PEERLOG_RECORDS - _data.count + i) % PEERLOG_RECORDS];
+    peer = r.peer;
+    sequence = r.sequence;
+    temperature = r.temperature / 100.0;
+    return true;
+}
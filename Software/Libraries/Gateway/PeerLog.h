@@ -0,0 +1,60 @@
+#ifndef _PEERLOG_H
+#define _PEERLOG_H
+
+#include <Arduino.h>
+
+// Number of peers remembered, and records kept across all of them
+#define PEERLOG_PEERS 8
+#define PEERLOG_RECORDS 160
+
+/*
+ * Temperature records collected from several peers.
+ *
+ * Each peer is known by its Bluetooth address and numbers its own
+ * samples. The log remembers the last sample number stored for each
+ * peer so that only new samples are added. Records are kept in one ring
+ * shared by all peers, oldest dropped first.
+ *
+ * The whole log is a single block of plain data so it can be copied to
+ * and from non-volatile memory as it is.
+ */
+class PeerLog {
+    private:
+        typedef struct {
+            char address[13];
+            uint32_t lastSequence;
+        } peerEntry;
+
+        typedef struct {
+            uint8_t peer;
+            int16_t temperature;    // In hundredths of a degree
+            uint32_t sequence;
+        } recordEntry;
+
+        struct {
+            peerEntry peers[PEERLOG_PEERS];
+            recordEntry records[PEERLOG_RECORDS];
+            uint16_t head;
+            uint16_t count;
+        } _data;
+
+    public:
+        PeerLog() { clear(); }
+
+        void clear();
+        bool validate();
+
+        int find(const char *address);
+        int add(const char *address);
+        const char *address(int peer);
+        uint32_t lastSequence(int peer);
+
+        void store(int peer, uint32_t sequence, float temperature);
+        size_t size() { return _data.count; }
+        bool get(size_t i, int &peer, uint32_t &sequence, float &temperature);
+
+        void *data() { return &_data; }
+        size_t dataSize() { return sizeof(_data); }
+};
+
+#endif
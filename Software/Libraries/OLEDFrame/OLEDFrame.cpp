@@ -0,0 +1,210 @@
+#include <OLEDFrame.h>
+
+// Just the characters the readouts need, in the usual 5x7 font
+static const char glyphChars[] = " -.0123456789:C";
+static const uint8_t glyphs[][5] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00 }, // space
+    { 0x08, 0x08, 0x08, 0x08, 0x08 }, // -
+    { 0x00, 0x60, 0x60, 0x00, 0x00 }, // .
+    { 0x3E, 0x51, 0x49, 0x45, 0x3E }, // 0
+    { 0x00, 0x42, 0x7F, 0x40, 0x00 }, // 1
+    { 0x42, 0x61, 0x51, 0x49, 0x46 }, // 2
+    { 0x21, 0x41, 0x45, 0x4B, 0x31 }, // 3
+    { 0x18, 0x14, 0x12, 0x7F, 0x10 }, // 4
+    { 0x27, 0x45, 0x45, 0x45, 0x39 }, // 5
+    { 0x3C, 0x4A, 0x49, 0x49, 0x30 }, // 6
+    { 0x01, 0x71, 0x09, 0x05, 0x03 }, // 7
+    { 0x36, 0x49, 0x49, 0x49, 0x36 }, // 8
+    { 0x06, 0x49, 0x49, 0x29, 0x1E }, // 9
+    { 0x00, 0x36, 0x36, 0x00, 0x00 }, // :
+    { 0x3E, 0x41, 0x41, 0x41, 0x22 }, // C
+};
+
+void OLEDLayer::clear() {
+    memset(bits, 0, sizeof(bits));
+}
+
+void OLEDLayer::setPixel(int x, int y) {
+    if ((x < 0) || (x >= OLED_WIDTH) || (y < 0) || (y >= OLED_PAGES * 8)) {
+        return;
+    }
+    bits[y >> 3][x] |= 1 << (y & 7);
+}
+
+void OLEDLayer::drawLine(int x0, int y0, int x1, int y1) {
+    int dx = abs(x1 - x0);
+    int dy = -abs(y1 - y0);
+    int sx = (x0 < x1) ? 1 : -1;
+    int sy = (y0 < y1) ? 1 : -1;
+    int err = dx + dy;
+
+    while (true) {
+        setPixel(x0, y0);
+        if ((x0 == x1) && (y0 == y1)) {
+            break;
+        }
+        int e2 = 2 * err;
+        if (e2 >= dy) {
+            err += dy;
+            x0 += sx;
+        }
+        if (e2 <= dx) {
+            err += dx;
+            y0 += sy;
+        }
+    }
+}
+
+/*! Move everything n columns to the left, blanking the columns on the
+ *  right. Whole words move across, and the columns left over are shifted
+ *  through the word boundaries.
+ */
+void OLEDLayer::scrollLeft(int n) {
+    int k = n >> 2;
+    int r = (n & 3) * 8;
+
+    for (int p = 0; p < OLED_PAGES; p++) {
+        uint32_t *w = words[p];
+        for (int i = 0; i < OLED_WORDS; i++) {
+            uint32_t lo = (i + k < OLED_WORDS) ? w[i + k] : 0;
+            uint32_t hi = (i + k + 1 < OLED_WORDS) ? w[i + k + 1] : 0;
+            w[i] = r ? (lo >> r) | (hi << (32 - r)) : lo;
+        }
+    }
+}
+
+/*! Draw text along a page, six columns a character. Characters without
+ *  a glyph are left blank.
+ *
+ *  Returns the column after the text.
+ */
+int OLEDLayer::drawText(int x, int page, const char *s) {
+    if ((page < 0) || (page >= OLED_PAGES)) {
+        return x;
+    }
+    for (; *s; s++) {
+        const char *g = strchr(glyphChars, *s);
+        int i = (g == NULL) ? 0 : g - glyphChars;
+        for (int c = 0; c < 6; c++, x++) {
+            if ((x >= 0) && (x < OLED_WIDTH)) {
+                bits[page][x] = (c < 5) ? glyphs[i][c] : 0;
+            }
+        }
+    }
+    return x;
+}
+
+/*! Queue commands behind anything already waiting. They are copied, so
+ *  the caller's array can go once this returns.
+ */
+void OLEDFrame::queueCommands(const uint8_t *cmds, size_t len) {
+    if (_device < 0) {
+        return;
+    }
+    _bus->wait(_cmd);
+    memcpy(_cmds, cmds, len);
+    _cmd.device = _device;
+    _cmd.command = true;
+    _cmd.tx = _cmds;
+    _cmd.rx = NULL;
+    _cmd.len = len;
+    // Other devices may have filled the queue
+    while (!_bus->queue(_cmd)) {
+        _bus->poll();
+    }
+}
+
+/*! Switch the panel to horizontal addressing, so a window of whole pages
+ *  can be written in one run. Call after the panel has been initialised.
+ */
+void OLEDFrame::begin() {
+    static const uint8_t horizontal[] = { 0x20, 0x00 };
+
+    if (_device < 0) {
+        // The SSD1306 takes up to 10MHz
+        _device = _bus->addDevice(_cs, DSPI_MODE0, 8000000, _dc);
+    }
+    queueCommands(horizontal, sizeof(horizontal));
+    invalidate();
+}
+
+/*! Display off, then charge pump off. The panel draws a few uA like this.
+ *  Waits for the commands to go, so its supply can be cut straight after.
+ */
+void OLEDFrame::sleep() {
+    static const uint8_t off[] = { 0xAE, 0x8D, 0x10 };
+    queueCommands(off, sizeof(off));
+    _bus->wait(_cmd);
+}
+
+/*! Charge pump on, then display on, showing what was there before. */
+void OLEDFrame::wake() {
+    static const uint8_t on[] = { 0x8D, 0x14, 0xAF };
+    queueCommands(on, sizeof(on));
+}
+
+/*! Rebuild the frame from the layers and the background, OR-ed together
+ *  a word at a time, and note which pages now differ from what the panel
+ *  shows.
+ */
+void OLEDFrame::compose(OLEDLayer * const *layers, int count, const OLEDPattern *background) {
+    // The frame may still be on its way out
+    waitFlush();
+    for (int p = 0; p < OLED_PAGES; p++) {
+        for (int w = 0; w < OLED_WORDS; w++) {
+            uint32_t v = (background == NULL) ? 0 : (*background)[p][w & 1];
+            for (int l = 0; l < count; l++) {
+                v |= layers[l]->words[p][w];
+            }
+            if (v != _words[p][w]) {
+                _words[p][w] = v;
+                _dirty |= 1 << p;
+            }
+        }
+    }
+}
+
+/*! Send the changed pages, from the first to the last in one window. */
+void OLEDFrame::flush() {
+    int first = 0;
+    int last = OLED_PAGES - 1;
+
+    if ((_dirty == 0) || (_device < 0)) {
+        return;
+    }
+    // The last flush is still queued, and the frame may have changed under it
+    waitFlush();
+    while (!(_dirty & (1 << first))) {
+        first++;
+    }
+    while (!(_dirty & (1 << last))) {
+        last--;
+    }
+
+    uint8_t window[] = {
+        0x21, OLED_COLUMN_OFFSET, OLED_COLUMN_OFFSET + OLED_WIDTH - 1,
+        0x22, (uint8_t)first, (uint8_t)last
+    };
+    queueCommands(window, sizeof(window));
+    _dirty = 0;
+
+    // Queued straight behind the window, so both go under one select
+    _data.device = _device;
+    _data.command = false;
+    _data.tx = _frame[first];
+    _data.rx = NULL;
+    _data.len = (last - first + 1) * OLED_WIDTH;
+    while (!_bus->queue(_data)) {
+        _bus->poll();
+    }
+}
+
+/*! True once the last flush has gone out and the frame is free again. */
+bool OLEDFrame::flushComplete() {
+    _bus->poll();
+    return _data.done;
+}
+
+void OLEDFrame::waitFlush() {
+    _bus->wait(_data);
+}
@@ -0,0 +1,87 @@
+#ifndef _OLEDFRAME_H
+#define _OLEDFRAME_H
+
+#include <Arduino.h>
+#include <SPIBus.h>
+
+// The OLED B click panel is 96x39: 96 of the SSD1306's 128 columns and
+// five pages, the last one only partly visible.
+#define OLED_WIDTH 96
+#define OLED_PAGES 5
+#define OLED_COLUMN_OFFSET 32
+#define OLED_WORDS (OLED_WIDTH / 4)
+
+// A background that repeats every eight columns, as two words per page
+typedef uint32_t OLEDPattern[OLED_PAGES][2];
+
+/*
+ * A 1bpp bitmap laid out the way the SSD1306 stores it: a page is eight
+ * rows, one byte per column, bit 0 at the top. Each page can also be
+ * worked on as words of four columns, the leftmost in the low byte.
+ */
+class OLEDLayer {
+    public:
+        union {
+            uint8_t bits[OLED_PAGES][OLED_WIDTH];
+            uint32_t words[OLED_PAGES][OLED_WORDS];
+        };
+
+        OLEDLayer() { clear(); }
+
+        void clear();
+        void setPixel(int x, int y);
+        void drawLine(int x0, int y0, int x1, int y1);
+        void scrollLeft(int n);
+        int drawText(int x, int page, const char *s);
+};
+
+/*
+ * The frame as last sent to the panel, built by OR-ing layers together.
+ *
+ * Composing marks the pages that changed, and only those are sent on the
+ * next flush, so the panel must be left in the state the previous flush
+ * left it in. Call invalidate() after anything else has drawn on it or
+ * it has lost power.
+ *
+ * sleep() turns the panel and its charge pump off but keeps its memory,
+ * so as long as it stays powered, wake() brings the same picture back.
+ *
+ * flush() queues the pages on the SPI bus and returns. The frame must not
+ * change until flushComplete() has returned true, so compose() waits for
+ * that first.
+ */
+class OLEDFrame {
+    private:
+        SPIBus *_bus;
+        uint8_t _cs;
+        uint8_t _dc;
+        int8_t _device;
+        union {
+            uint8_t _frame[OLED_PAGES][OLED_WIDTH];
+            uint32_t _words[OLED_PAGES][OLED_WORDS];
+        };
+        uint8_t _dirty;
+        uint8_t _cmds[8];
+        SPIBus::Transaction _cmd;
+        SPIBus::Transaction _data;
+
+        void queueCommands(const uint8_t *cmds, size_t len);
+
+    public:
+        OLEDFrame(SPIBus &bus, uint8_t cs, uint8_t dc) : _bus(&bus), _cs(cs), _dc(dc), _device(-1), _dirty(0) {
+            _cmd.done = true;
+            _data.done = true;
+        }
+
+        void begin();
+        void sleep();
+        void wake();
+        void compose(OLEDLayer * const *layers, int count, const OLEDPattern *background = NULL);
+        void invalidate() { _dirty = (1 << OLED_PAGES) - 1; }
+        bool dirty() { return _dirty != 0; }
+        void flush();
+        bool flushComplete();
+        void waitFlush();
+};
+
+#endif
@@ -0,0 +1,96 @@
+#include <PowerProfiles.h>
+#include <errno.h>
+
+#define CFGCON_PMDLOCK 0x00001000
+
+/*! Put the base profile in force, switching off everything it doesn't
+ *  name.
+ */
+void PowerProfiles::begin(const PowerProfile &base) {
+    _base = &base;
+    _active = 0;
+    for (int i = 0; i < PMD_REGISTERS; i++) {
+        _written[i] = base.pmd[i];
+    }
+    write(_written);
+}
+
+/*! Returns the profile's id for enter() and leave(), or -1 with errno
+ *  set to ENOSPC.
+ */
+int PowerProfiles::add(const PowerProfile &profile) {
+    if (_count >= POWERPROFILES_MAX) {
+        errno = ENOSPC;
+        return -1;
+    }
+    _profiles[_count] = &profile;
+    return _count++;
+}
+
+void PowerProfiles::enter(int id) {
+    if ((id < 0) || (id >= _count) || (_active & (1UL << id))) {
+        return;
+    }
+    _active |= 1UL << id;
+    update();
+}
+
+void PowerProfiles::leave(int id) {
+    if ((id < 0) || (id >= _count) || !(_active & (1UL << id))) {
+        return;
+    }
+    _active &= ~(1UL << id);
+    update();
+}
+
+// A module is on if any profile in force wants it, so the words are
+// AND-ed together. They are only written if that changes anything.
+void PowerProfiles::update() {
+    uint32_t pmd[PMD_REGISTERS];
+    bool changed = false;
+
+    for (int i = 0; i < PMD_REGISTERS; i++) {
+        pmd[i] = _base->pmd[i];
+        for (int p = 0; p < _count; p++) {
+            if (_active & (1UL << p)) {
+                pmd[i] &= _profiles[p]->pmd[i];
+            }
+        }
+        if (pmd[i] != _written[i]) {
+            _written[i] = pmd[i];
+            changed = true;
+        }
+    }
+    if (changed) {
+        write(_written);
+    }
+}
+
+/*! Write all six PMD registers. They are locked by PMDLOCK, which can
+ *  only be cleared after the system unlock sequence, so interrupts are
+ *  held off from the unlock until everything is locked again.
+ */
+void PowerProfiles::write(const uint32_t *pmd) {
+#if defined(__PIC32MX__)
+    uint32_t status = disableInterrupts();
+
+    SYSKEY = 0;
+    SYSKEY = 0xAA996655;
+    SYSKEY = 0x556699AA;
+    CFGCONCLR = CFGCON_PMDLOCK;
+
+    PMD1 = pmd[0];
+    PMD2 = pmd[1];
+    PMD3 = pmd[2];
+    PMD4 = pmd[3];
+    PMD5 = pmd[4];
+    PMD6 = pmd[5];
+
+    CFGCONSET = CFGCON_PMDLOCK;
+    SYSKEY = 0;
+
+    restoreInterrupts(status);
+#else
+    (void)pmd;
+#endif
+}
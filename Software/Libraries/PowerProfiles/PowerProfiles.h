@@ -0,0 +1,114 @@
+#ifndef _POWERPROFILES_H
+#define _POWERPROFILES_H
+
+#include <Arduino.h>
+
+// Peripheral modules of the PIC32MX1xx/2xx, one bit each, grouped by the
+// PMD register that switches them
+#define PMD_ADC     0x00000001UL
+#define PMD_CTMU    0x00000002UL
+#define PMD_CVR     0x00000004UL
+
+#define PMD_CMP1    0x00000008UL
+#define PMD_CMP2    0x00000010UL
+#define PMD_CMP3    0x00000020UL
+
+#define PMD_IC1     0x00000040UL
+#define PMD_IC2     0x00000080UL
+#define PMD_IC3     0x00000100UL
+#define PMD_IC4     0x00000200UL
+#define PMD_IC5     0x00000400UL
+#define PMD_OC1     0x00000800UL
+#define PMD_OC2     0x00001000UL
+#define PMD_OC3     0x00002000UL
+#define PMD_OC4     0x00004000UL
+#define PMD_OC5     0x00008000UL
+
+#define PMD_T1      0x00010000UL
+#define PMD_T2      0x00020000UL
+#define PMD_T3      0x00040000UL
+#define PMD_T4      0x00080000UL
+#define PMD_T5      0x00100000UL
+
+#define PMD_UART1   0x00200000UL
+#define PMD_UART2   0x00400000UL
+#define PMD_SPI1    0x00800000UL
+#define PMD_SPI2    0x01000000UL
+#define PMD_I2C1    0x02000000UL
+#define PMD_I2C2    0x04000000UL
+#define PMD_USB     0x08000000UL
+
+#define PMD_RTCC    0x10000000UL
+#define PMD_REFO    0x20000000UL
+#define PMD_PMP     0x40000000UL
+
+#define PMD_REGISTERS 6
+
+// The PMDx word for a set of enabled modules: a 1 disables a module, so
+// every implemented bit is set except those of the modules wanted.
+#define _PMD_BIT(m, mod, bit) ((((m) & (mod)) ? 0UL : 1UL) << (bit))
+
+#define _PMD1(m) (_PMD_BIT(m, PMD_ADC, 0) | _PMD_BIT(m, PMD_CTMU, 8) | _PMD_BIT(m, PMD_CVR, 12))
+#define _PMD2(m) (_PMD_BIT(m, PMD_CMP1, 0) | _PMD_BIT(m, PMD_CMP2, 1) | _PMD_BIT(m, PMD_CMP3, 2))
+#define _PMD3(m) (_PMD_BIT(m, PMD_IC1, 0) | _PMD_BIT(m, PMD_IC2, 1) | _PMD_BIT(m, PMD_IC3, 2) | \
+                  _PMD_BIT(m, PMD_IC4, 3) | _PMD_BIT(m, PMD_IC5, 4) | \
+                  _PMD_BIT(m, PMD_OC1, 16) | _PMD_BIT(m, PMD_OC2, 17) | _PMD_BIT(m, PMD_OC3, 18) | \
+                  _PMD_BIT(m, PMD_OC4, 19) | _PMD_BIT(m, PMD_OC5, 20))
+#define _PMD4(m) (_PMD_BIT(m, PMD_T1, 0) | _PMD_BIT(m, PMD_T2, 1) | _PMD_BIT(m, PMD_T3, 2) | \
+                  _PMD_BIT(m, PMD_T4, 3) | _PMD_BIT(m, PMD_T5, 4))
+#define _PMD5(m) (_PMD_BIT(m, PMD_UART1, 0) | _PMD_BIT(m, PMD_UART2, 1) | \
+                  _PMD_BIT(m, PMD_SPI1, 8) | _PMD_BIT(m, PMD_SPI2, 9) | \
+                  _PMD_BIT(m, PMD_I2C1, 16) | _PMD_BIT(m, PMD_I2C2, 17) | _PMD_BIT(m, PMD_USB, 24))
+#define _PMD6(m) (_PMD_BIT(m, PMD_RTCC, 0) | _PMD_BIT(m, PMD_REFO, 1) | _PMD_BIT(m, PMD_PMP, 16))
+
+/*
+ * The peripherals one activity needs, as the six PMD register words
+ * worked out when compiling:
+ *
+ *     const PowerProfile radio = POWER_PROFILE(PMD_UART2);
+ *
+ * Everything not named is switched off.
+ */
+typedef struct {
+    uint32_t pmd[PMD_REGISTERS];
+} PowerProfile;
+
+#define POWER_PROFILE(m) {{ _PMD1(m), _PMD2(m), _PMD3(m), _PMD4(m), _PMD5(m), _PMD6(m) }}
+
+#define POWERPROFILES_MAX 8
+
+/*
+ * Keeps each peripheral switched on only while some activity that needs
+ * it is going on.
+ *
+ * The base profile given to begin() is always in force. Others are
+ * entered and left as activities start and stop, and the peripherals on
+ * are those of the base and every profile entered. Changes are written
+ * to the PMD registers in one go, under a single unlock.
+ *
+ * Switching a peripheral off resets it, so anything using it has to be
+ * set up again after its profile has been entered.
+ */
+class PowerProfiles {
+    private:
+        const PowerProfile *_base;
+        const PowerProfile *_profiles[POWERPROFILES_MAX];
+        uint8_t _count;
+        uint32_t _active;
+        uint32_t _written[PMD_REGISTERS];
+
+        void update();
+
+    public:
+        PowerProfiles() : _base(NULL), _count(0), _active(0) {}
+
+        void begin(const PowerProfile &base);
+        int add(const PowerProfile &profile);
+        void enter(int id);
+        void leave(int id);
+        bool active(int id) { return (id >= 0) && (id < _count) && (_active & (1UL << id)); }
+
+        static void write(const uint32_t *pmd);
+};
+
+#endif
@@ -0,0 +1,177 @@
+#include <PowerRails.h>
+#include <errno.h>
+
+/*! Give the rails a one-shot scheduler task whose function calls
+ *  expire(), for timing holds.
+ */
+void PowerRails::begin(RTCCScheduler &scheduler, int task) {
+    _scheduler = &scheduler;
+    _task = task;
+}
+
+/*! Add a rail switched by a pin, active high. It starts off.
+ *
+ *  add<pin>() switches it with fastDigitalWrite(), a single latch write,
+ *  and sets the pin's direction once, so anything parking pins when a
+ *  rail goes off has to leave the rail pins alone:
+ *
+ *      sensor = rails.add<PIN_SENSOR_POWER>(5, 2);
+ *
+ *  settle is how long in ms what it feeds takes to come up, and hold how
+ *  many seconds it stays on after the last user releases it. off, if
+ *  given, is called each time it has been switched off, to park the
+ *  pins of what it feeds.
+ *
+ *  Returns the rail's id, or -1 with errno set to ENOSPC.
+ */
+int PowerRails::add(void (*power)(bool on), uint16_t settle, uint32_t hold, void (*off)()) {
+    if (_count >= POWERRAILS_MAX) {
+        errno = ENOSPC;
+        return -1;
+    }
+    rail &r = _rails[_count];
+    r.users = 0;
+    r.on = false;
+    r.pending = false;
+    r.settle = settle;
+    r.powerCount = 0;
+    r.hold = hold;
+    r.off = off;
+    r.power = power;
+    r.power(false);
+    return _count++;
+}
+
+void PowerRails::switchOn(rail &r) {
+    r.power(true);
+    r.on = true;
+    r.onAt = millis();
+    r.powerCount++;
+}
+
+void PowerRails::switchOff(rail &r) {
+    r.power(false);
+    r.on = false;
+    r.pending = false;
+    if (r.off != NULL) {
+        r.off();
+    }
+}
+
+/*! Start using a rail, switching it on if it is off.
+ *
+ *  Returns true if it was switched on, so what it feeds has lost power
+ *  since it was last used.
+ */
+bool PowerRails::acquire(int id) {
+    if (!valid(id)) {
+        return false;
+    }
+    rail &r = _rails[id];
+    r.users++;
+    if (r.on) {
+        return false;
+    }
+    switchOn(r);
+    return true;
+}
+
+void PowerRails::release(int id) {
+    if (valid(id)) {
+        release(id, _rails[id].hold);
+    }
+}
+
+/*! Stop using a rail. The last user out starts its hold, which here is
+ *  hold seconds instead of the rail's own; 0 switches it off at once if
+ *  no longer hold is still running.
+ */
+void PowerRails::release(int id, uint32_t hold) {
+    if (!valid(id) || (_rails[id].users == 0)) {
+        return;
+    }
+    rail &r = _rails[id];
+    if (--r.users > 0) {
+        return;
+    }
+    uint32_t now = (_scheduler == NULL) ? 0 : _scheduler->now();
+    if (r.pending && ((int32_t)(r.offAt - now) > 0)) {
+        if ((int32_t)(now + hold - r.offAt) > 0) {
+            r.offAt = now + hold;
+        }
+    } else if ((hold == 0) || (_scheduler == NULL)) {
+        switchOff(r);
+        return;
+    } else {
+        r.offAt = now + hold;
+        r.pending = true;
+    }
+    schedule();
+}
+
+/*! Switch a rail off and on again, to reset what it feeds. Its users
+ *  are unchanged.
+ */
+void PowerRails::restart(int id) {
+    if (!valid(id)) {
+        return;
+    }
+    rail &r = _rails[id];
+    if (r.on) {
+        switchOff(r);
+        delay(r.settle);
+    }
+    switchOn(r);
+}
+
+/*! Switch off the rails whose hold is over and nobody has acquired
+ *  since. Called from the scheduler task.
+ */
+void PowerRails::expire() {
+    uint32_t now = _scheduler->now();
+    for (int i = 0; i < _count; i++) {
+        rail &r = _rails[i];
+        if (r.on && r.pending && (r.users == 0) && ((int32_t)(r.offAt - now) <= 0)) {
+            switchOff(r);
+        }
+    }
+    schedule();
+}
+
+// Arm the task for the earliest hold still running
+void PowerRails::schedule() {
+    uint32_t now = _scheduler->now();
+    bool any = false;
+    uint32_t next = 0;
+
+    for (int i = 0; i < _count; i++) {
+        rail &r = _rails[i];
+        if (!r.on || !r.pending || (r.users > 0)) {
+            continue;
+        }
+        if (!any || ((int32_t)(r.offAt - next) < 0)) {
+            next = r.offAt;
+            any = true;
+        }
+    }
+    if (!any) {
+        _scheduler->stop(_task);
+        return;
+    }
+    _scheduler->start(_task, ((int32_t)(next - now) > 0) ? next - now : 0);
+}
+
+/*! True once a rail is on and has had its settle time. */
+bool PowerRails::ready(int id) {
+    if (!powered(id)) {
+        return false;
+    }
+    return (millis() - _rails[id].onAt) >= _rails[id].settle;
+}
+
+void PowerRails::wait(int id) {
+    if (!powered(id)) {
+        return;
+    }
+    while (!ready(id));
+}
@@ -0,0 +1,84 @@
+#ifndef _POWERRAILS_H
+#define _POWERRAILS_H
+
+#include <Arduino.h>
+#include <RTCCScheduler.h>
+
+#define POWERRAILS_MAX 4
+
+// Switches the rail on pin through FastPin, worked out when compiling
+template <uint8_t pin> static void powerRailSwitch(bool on) {
+    fastDigitalWrite<pin>(on ? HIGH : LOW);
+}
+
+/*
+ * Switched supply rails shared by several devices.
+ *
+ * Each user acquires a rail before using what it feeds and releases it
+ * when done. The rail is switched on by the first user and, once the
+ * last one has let go, switched off after its hold time, unless someone
+ * acquires it again first. A release can ask for a longer hold than
+ * usual; a rail is never switched off before the longest hold asked for
+ * since it was last in use.
+ *
+ * acquire() says whether the rail had to be switched on, and
+ * powerCount() goes up every time it is, so a device only needs setting
+ * up again if the rail has been off since it last was. ready() turns
+ * true once the rail has had its settle time.
+ *
+ * Holds are timed by a one-shot scheduler task that calls expire().
+ */
+class PowerRails {
+    private:
+        typedef struct {
+            uint8_t users;
+            bool on;
+            bool pending;       // Switch off at offAt
+            uint16_t settle;    // ms from switching on until usable
+            uint16_t powerCount;
+            uint32_t hold;      // Seconds kept on after the last release
+            uint32_t offAt;
+            uint32_t onAt;      // millis() when switched on
+            void (*off)();
+            void (*power)(bool on);
+        } rail;
+
+        rail _rails[POWERRAILS_MAX];
+        uint8_t _count;
+        RTCCScheduler *_scheduler;
+        int _task;
+
+        bool valid(int id) { return (id >= 0) && (id < _count); }
+        int add(void (*power)(bool on), uint16_t settle, uint32_t hold, void (*off)());
+        void switchOn(rail &r);
+        void switchOff(rail &r);
+        void schedule();
+
+    public:
+        PowerRails() : _count(0), _scheduler(NULL), _task(-1) {}
+
+        void begin(RTCCScheduler &scheduler, int task);
+
+        // The pin is made an output here, once, and must stay one
+        template <uint8_t pin> int add(uint16_t settle, uint32_t hold, void (*off)() = NULL) {
+            int id = add(powerRailSwitch<pin>, settle, hold, off);
+            if (id >= 0) {
+                pinMode(pin, OUTPUT);
+            }
+            return id;
+        }
+
+        bool acquire(int id);
+        void release(int id);
+        void release(int id, uint32_t hold);
+        void restart(int id);
+        void expire();
+
+        bool powered(int id) { return valid(id) && _rails[id].on; }
+        bool ready(int id);
+        void wait(int id);
+        uint8_t users(int id) { return valid(id) ? _rails[id].users : 0; }
+        uint16_t powerCount(int id) { return valid(id) ? _rails[id].powerCount : 0; }
+};
+
+#endif
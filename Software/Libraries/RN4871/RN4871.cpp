@@ -1,19 +1,121 @@
 #include <RN4871.h>
 #include <errno.h>
 
+const RN4871::ConnectionProfile RN4871::Burst = {   6,  12, 0, 200 }; // 7.5-15ms, 2s
+const RN4871::ConnectionProfile RN4871::Idle  = { 320, 400, 4, 600 }; // 400-500ms, 6s
+
+/* Settings the module takes as a code rather than as the value itself.
+ *
+ * Code n stands for values[n - first], or for the value n itself when
+ * there is no value list. The same table encodes the set command and
+ * decodes the get reply.
+ */
+class RN4871::CodedSetting {
+    public:
+        const char *set;
+        const char *get;
+        const uint32_t *values;
+        uint8_t first;
+        uint8_t count;
+        uint8_t digits;
+};
+
+static const uint32_t baudRates[] = {
+    921600, 460800, 230400, 115200, 57600, 38400,
+    28800, 19200, 14400, 9600, 4800, 2400
+};
+
+static const uint32_t pinNumbers[] = { 12, 13, 16, 17 };
+
+const RN4871::CodedSetting RN4871::BaudRate          = { "SB",  "GB",  baudRates,    0, 12, 2 };
+const RN4871::CodedSetting RN4871::AuthenticationMode = { "SA",  "GA",  NULL,         1,  3, 1 };
+const RN4871::CodedSetting RN4871::BeaconMode        = { "SC",  "GC",  NULL,         0,  3, 1 };
+const RN4871::CodedSetting RN4871::AdvertisementPower = { "SGA", "GGA", NULL,         0,  6, 1 };
+const RN4871::CodedSetting RN4871::ConnectedPower    = { "SGC", "GGC", NULL,         0,  6, 1 };
+const RN4871::CodedSetting RN4871::PinNumber         = { NULL,  NULL,  pinNumbers, 0x0A, 4, 2 };
+const RN4871::CodedSetting RN4871::PinFunction       = { NULL,  NULL,  NULL,         0, 13, 2 };
+
+static bool encode(const RN4871::CodedSetting &s, uint32_t value, char *buf) {
+    for (uint8_t i = 0; i < s.count; i++) {
+        if ((s.values != NULL ? s.values[i] : s.first + i) == value) {
+            formatHex(buf, s.first + i, s.digits);
+            return true;
+        }
+    }
+    errno = EINVAL;
+    return false;
+}
+
+static bool decode(const RN4871::CodedSetting &s, const char *buf, uint32_t &value) {
+    uint32_t code;
+    if (!parseHex(buf, code) || (code < s.first) || (code >= (uint32_t)s.first + s.count)) {
+        errno = ENOMSG;
+        return false;
+    }
+    value = (s.values != NULL) ? s.values[code - s.first] : code;
+    return true;
+}
+
+// Four comma separated 16 bit fields, as taken by ST and T
+static void connectionArgs(char *p, uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout) {
+    p = formatHex(p, minInterval, 4);
+    *p++ = ',';
+    p = formatHex(p, maxInterval, 4);
+    *p++ = ',';
+    p = formatHex(p, latency, 4);
+    *p++ = ',';
+    formatHex(p, timeout, 4);
+}
+
+/*! Check connection parameters against the limits in the Bluetooth spec.
+ *
+ *  The supervision timeout has to outlast the longest gap the latency
+ *  allows, or the link drops whenever the module skips events.
+ */
+static bool validConnectionParameters(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout) {
+    if ((minInterval < 6) || (maxInterval > 3200) || (minInterval > maxInterval)) {
+        return false;
+    }
+    if ((latency > 499) || (timeout < 10) || (timeout > 3200)) {
+        return false;
+    }
+    // timeout * 10ms > (1 + latency) * maxInterval * 1.25ms * 2
+    return ((uint32_t)timeout * 4) > ((uint32_t)(1 + latency) * maxInterval);
+}
+
 /*! Low level command-response routine.
  *
  *  Writes a command then reads up until a new-line. If a newline is not found
  *  within 1 second it times out and returns false.  An optional response buffer
- *  will receive the response the command replied with.
+ *  of len bytes will receive the response the command replied with, cut
+ *  short if it does not fit.
  *
  *  On success returns true. On error returns false. errno is set to indicate
  *  what went wrong:
  * 
  *  EBUSY: Timed out in communication
- *  EINVAL: Command replied with ERR
+ *  EINVAL: Command replied with Err
+ */
+bool RN4871::command(const char *command, const char *data, char *resp, size_t len) {
+    return this->command(command, data, NULL, resp, len);
+}
+
+/*! As above, with the argument sent in two comma separated parts. */
+bool RN4871::command(const char *command, const char *data, const char *data2, char *resp, size_t len) {
+    while (!commandTask(command, data, data2, resp, len));
+    return commandResult();
+}
+
+/*! Resumable version of command().
+ *
+ *  Returns false while waiting for the reply and true once it has
+ *  arrived or timed out. commandResult() and errno then say how it went,
+ *  as for command(). The arguments must stay the same between calls.
  */
-bool RN4871::command(const char *command, const char *data, char *resp) {
+bool RN4871::commandTask(const char *command, const char *data, const char *data2, char *resp, size_t len) {
+    CO_BEGIN(_co);
+    CO_WAIT_UNTIL(_co, writeComplete());
+
     // Flush any noise from the incoming buffer
     while (_dev->available()) {
         (void)_dev->read();
@@ -24,36 +126,64 @@ bool RN4871::command(const char *command, const char *data, char *resp) {
         _dev->print(",");
         _dev->print(data);
     }
+    if (data2 != NULL) {
+        _dev->print(",");
+        _dev->print(data2);
+    }
     _dev->print("\r");
 
-    uint32_t timeout = millis();
-    char line[5] = {0, 0, 0, 0, 0}; // Enough room for ERR and a bit.
-    int lpos = 0;
-    int inch;
-    errno = 0;
-    while (millis() - timeout < 1000) { // 1 second timeout for a response
+    _ts = millis();
+    _lpos = 0;
+    _errno = EBUSY;
+    _result = false;
+    while (millis() - _ts < 1000) { // 1 second timeout for a response
+        int inch;
         inch = _dev->read();
-        if (inch < 0) continue;
+        if (inch < 0) {
+            CO_YIELD(_co);
+            continue;
+        }
+        // The end of the previous reply and its prompt may still be
+        // arriving when the command is sent.
+        if (inch == '\n') continue;
+        if ((_lpos == 4) && (inch == ' ') && !strncmp(_line, "CMD>", 4)) {
+            _lpos = 0;
+            continue;
+        }
         if (inch == '\r') {
-            if (line[0] == 'E' && line[1] == 'R' && line[2] == 'R') {
-                errno = EINVAL;
-                return false;
-            } else {
-                return true;
+            _line[_lpos] = 0;
+            if ((resp != NULL) && (len > 0)) {
+                strncpy(resp, _line, len - 1);
+                resp[len - 1] = 0;
             }
+            _result = strcmp(_line, "Err") != 0;
+            _errno = _result ? 0 : EINVAL;
+            break;
         }
-        if (resp != NULL) {
-            resp[lpos] = inch;
-            resp[lpos+1] = 0;
-        }
-        if (lpos < 4) {
-            line[lpos] = inch;
-            line[lpos+1] = 0;
+        if (_lpos < sizeof(_line) - 1) {
+            _line[_lpos++] = inch;
         }
-        lpos++;
     }
-    errno = EBUSY;
-    return false;
+    errno = _errno;
+    CO_END(_co);
+}
+
+/*! Set a coded setting, failing with EINVAL if the value has no code. */
+bool RN4871::setCoded(const CodedSetting &s, uint32_t value) {
+    char code[4];
+    if (!encode(s, value, code)) {
+        return false;
+    }
+    return command(s.set, code);
+}
+
+/*! Read back a coded setting, failing with ENOMSG if the reply is not a known code. */
+bool RN4871::getCoded(const CodedSetting &s, uint32_t &value) {
+    char buf[RN4871_STATUS_MAX];
+    if (!command(s.get, NULL, buf, sizeof(buf))) {
+        return false;
+    }
+    return decode(s, buf, value);
 }
 
 /* Do initial configuration of the module */
@@ -62,13 +192,108 @@ bool RN4871::enterCommandMode() {
     delay(120);
     _dev->print("$$$");
     delay(120);
+    return true;
 }
 
 bool RN4871::enterDataMode() {
     _dev->print("---\r");
+    return true;
 }
 
 bool RN4871::begin() {
+    return true;
+}
+
+/*! Read the next status message from the module.
+ *
+ *  Status messages are wrapped in the default % delimiters. Anything
+ *  outside them is thrown away. The text between the delimiters is
+ *  copied to buf, cut short to fit len bytes. Returns false with errno
+ *  set to EBUSY if no complete message arrived within timeout ms.
+ */
+bool RN4871::readStatus(char *buf, size_t len, uint32_t timeout) {
+    size_t pos = 0;
+    bool inside = false;
+    uint32_t ts = millis();
+    while (millis() - ts < timeout) {
+        int inch = _dev->read();
+        if (inch < 0) continue;
+        if (inch == '%') {
+            if (inside) {
+                buf[pos] = 0;
+                return true;
+            }
+            inside = true;
+            pos = 0;
+            continue;
+        }
+        if (inside && (pos < len - 1)) {
+            buf[pos++] = inch;
+        }
+    }
+    errno = EBUSY;
+    return false;
+}
+
+/*! Wait for a particular status message from the module.
+ *
+ *  event only has to match the start of the message, so "CONNECT" also
+ *  matches %CONNECT,0,001EC01D03EA%. Other messages that arrive in the
+ *  meantime are dropped. Returns false with errno set to EBUSY if the
+ *  message has not arrived within timeout ms.
+ */
+bool RN4871::waitForStatus(const char *event, uint32_t timeout) {
+    char status[RN4871_STATUS_MAX];
+    size_t elen = strlen(event);
+    uint32_t ts = millis();
+    while (millis() - ts < timeout) {
+        if (!readStatus(status, sizeof(status), timeout - (millis() - ts))) {
+            break;
+        }
+        if (strncmp(status, event, elen) == 0) {
+            return true;
+        }
+    }
+    errno = EBUSY;
+    return false;
+}
+
+/*! Wait for the module to finish booting.
+ *
+ *  The module prints %REBOOT% once it is ready after power-up, a reboot or
+ *  a factory reset. Returns true as soon as that has been seen, or false
+ *  with errno set to EBUSY if it has not arrived within timeout ms.
+ */
+bool RN4871::waitForBoot(uint32_t timeout) {
+    return waitForStatus("REBOOT", timeout);
+}
+
+/*! Tell the library which pin drives the module's UART_RX_IND line.
+ *
+ *  The line idles high. Pulling it low wakes the module from dormant and,
+ *  in low power mode, keeps its UART listening.
+ */
+void RN4871::setWakePin(int pin) {
+    _wakePin = pin;
+    if (_wakePin >= 0) {
+        pinMode(_wakePin, OUTPUT);
+        digitalWrite(_wakePin, HIGH);
+    }
+}
+
+/*! Bring the module out of dormant through UART_RX_IND.
+ *
+ *  The module comes back through a reboot with its stored configuration,
+ *  so this returns once %REBOOT% has been seen. The line is left low so
+ *  the UART stays awake. Fails with ENODEV if no wake pin has been set.
+ */
+bool RN4871::wake(uint32_t timeout) {
+    if (_wakePin < 0) {
+        errno = ENODEV;
+        return false;
+    }
+    digitalWrite(_wakePin, LOW);
+    return waitForBoot(timeout);
 }
 
 /* Set commands */
@@ -82,59 +307,30 @@ bool RN4871::setCommandModeCharacter(const char *character) {
 }
 
 bool RN4871::setDelimiters(const char *pre, const char *post) {
-    char temp[strlen(pre) + strlen(post) + 2];
-    sprintf(temp, "%s,%s", pre, post);
-    return command("S%", temp);
+    return command("S%", pre, post, NULL);
 }
 
-bool RN4871::setNVM(int address, const char *hex) {
-    char temp[strlen(hex) + 6];
-    sprintf(temp, "%04X,%s", address, hex);
-    return command("S:", temp);
+bool RN4871::setNVM(int address, const char *data) {
+    char addr[5];
+    formatHex(addr, address, 4);
+    return command("S:", addr, data, NULL);
 }
 
 bool RN4871::setAuthenticationMode(int mode) {
-    switch (mode) {
-        case 1: return command("SA", "1");
-        case 2: return command("SA", "2");
-        case 3: return command("SA", "3");
-    }
-    errno = EINVAL;
-    return false;
+    return setCoded(AuthenticationMode, mode);
 }
 
 bool RN4871::setBaudRate(uint32_t baud) {
-    switch (baud) {
-        case 921600: return command("SB", "00");
-        case 460800: return command("SB", "01");
-        case 230400: return command("SB", "02");
-        case 115200: return command("SB", "03");
-        case  57600: return command("SB", "04");
-        case  38400: return command("SB", "05");
-        case  28800: return command("SB", "06");
-        case  19200: return command("SB", "07");
-        case  14400: return command("SB", "08");
-        case   9600: return command("SB", "09");
-        case   4800: return command("SB", "0A");
-        case   2400: return command("SB", "0B");
-    }
-    errno = EINVAL;
-    return false;
+    return setCoded(BaudRate, baud);
 }
 
 bool RN4871::setBeacon(int mode) {
-    switch (mode) {
-        case 0: return command("SC", "0");
-        case 1: return command("SC", "1");
-        case 2: return command("SC", "2");
-    }
-    errno = EINVAL;
-    return false;
+    return setCoded(BeaconMode, mode);
 }
 
 bool RN4871::setDISAppearance(int mode) {
-    char temp[10];
-    sprintf(temp, "%04X", mode);
+    char temp[5];
+    formatHex(temp, mode, 4);
     return command("SDA", temp);
 }
 
@@ -167,29 +363,11 @@ bool RN4871::factoryReset() {
 }
 
 bool RN4871::setAdvertisementPower(int p) {
-    switch (p) {
-        case 0: command("SGA", "0");
-        case 1: command("SGA", "1");
-        case 2: command("SGA", "2");
-        case 3: command("SGA", "3");
-        case 4: command("SGA", "4");
-        case 5: command("SGA", "5");
-    }
-    errno = EINVAL;
-    return false;
+    return setCoded(AdvertisementPower, p);
 }
 
 bool RN4871::setConnectedPower(int p) {
-    switch (p) {
-        case 0: command("SGC", "0");
-        case 1: command("SGC", "1");
-        case 2: command("SGC", "2");
-        case 3: command("SGC", "3");
-        case 4: command("SGC", "4");
-        case 5: command("SGC", "5");
-    }
-    errno = EINVAL;
-    return false;
+    return setCoded(ConnectedPower, p);
 }
 
 bool RN4871::setDeviceName(const char *name) {
@@ -202,168 +380,176 @@ bool RN4871::setPin(const char *pin) {
 
 
 bool RN4871::setFeatures(uint16_t bitmap) {
-    char temp[6];
-    sprintf(temp, "%04X", bitmap);
+    char temp[5];
+    formatHex(temp, bitmap, 4);
     return command("SR", temp);
 }
 
 bool RN4871::setServices(uint8_t bitmap) {
-    char temp[10];
-    sprintf(temp, "%02X", bitmap);
+    char temp[3];
+    formatHex(temp, bitmap, 2);
     return command("SS", temp);
 }
 
 bool RN4871::setPinFunction(int pin, int function) {
-    char temp[10];
-    switch(pin) {
-        case 12: strcpy(temp, "0A"); break;
-        case 13: strcpy(temp, "0B"); break;
-        case 16: strcpy(temp, "0C"); break;
-        case 17: strcpy(temp, "0D"); break;
-        default:
-            errno = EINVAL;
-            return false;
+    char code[3], func[3];
+    if (!encode(PinNumber, pin, code) || !encode(PinFunction, function, func)) {
+        return false;
     }
-    strcat(temp, ",");
-    switch (function) {
-        case 0x00: strcat(temp, "00"); break;
-        case 0x01: strcat(temp, "01"); break;
-        case 0x02: strcat(temp, "02"); break;
-        case 0x03: strcat(temp, "03"); break;
-        case 0x04: strcat(temp, "04"); break;
-        case 0x05: strcat(temp, "05"); break;
-        case 0x06: strcat(temp, "06"); break;
-        case 0x07: strcat(temp, "07"); break;
-        case 0x08: strcat(temp, "08"); break;
-        case 0x09: strcat(temp, "09"); break;
-        case 0x0A: strcat(temp, "0A"); break;
-        case 0x0B: strcat(temp, "0B"); break;
-        case 0x0C: strcat(temp, "0C"); break;
-        default:
-            errno = EINVAL;
-            return false;
+    return command("SW", code, func, NULL, 0);
+}
+
+/*! Set the preferred connection parameters for future connections. */
+bool RN4871::setConnectionParameters(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout) {
+    if (!validConnectionParameters(minInterval, maxInterval, latency, timeout)) {
+        errno = EINVAL;
+        return false;
     }
+    char temp[20];
+    connectionArgs(temp, minInterval, maxInterval, latency, timeout);
+    return command("ST", temp);
+}
+
+bool RN4871::setConnectionParameters(const ConnectionProfile &p) {
+    return setConnectionParameters(p.minInterval, p.maxInterval, p.latency, p.timeout);
+}
 
-    return command("SW", temp);
+/*! Enable the module's low power mode. Takes effect after a reboot. */
+bool RN4871::setLowPower(bool on) {
+    return command("SO", on ? "1" : "0");
 }
 
 /* Getter functions */
 
-bool RN4871::getNVM(int address, int len, char *buf) {
-    char temp[20];
-    snprintf(temp, 20, "%04X,%02X", address, len);
-    return command("G:", temp, buf);
+bool RN4871::getNVM(int address, int len, char *buf, size_t buflen) {
+    char temp[8];
+    char *p = formatHex(temp, address, 4);
+    *p++ = ',';
+    formatHex(p, len, 2);
+    return command("G:", temp, buf, buflen);
 }
 
-bool RN4871::getConnectionStatus(char *buf) {
-    return command("GK", NULL, buf);
+bool RN4871::getConnectionStatus(char *buf, size_t len) {
+    return command("GK", NULL, buf, len);
 }
 
-bool RN4871::getPeerDeviceName(char *buf) {
-    return command("GNR", NULL, buf);
+bool RN4871::getPeerDeviceName(char *buf, size_t len) {
+    return command("GNR", NULL, buf, len);
 }
 
-bool RN4871::getSerializedDeviceName(char *buf) {
-    return command("G-", NULL, buf);
+bool RN4871::getSerializedDeviceName(char *buf, size_t len) {
+    return command("G-", NULL, buf, len);
 }
 
 char RN4871::getCommandModeCharacter() {
-    char buf[10];
-    if (command("G$", NULL, buf)) return 0;
+    char buf[RN4871_STATUS_MAX];
+    if (!command("G$", NULL, buf, sizeof(buf))) return 0;
     return buf[0];
 }
 
 bool RN4871::getDelimiters(char *pre, char *post) {
-    char temp[20];
-    if (!command("G%", NULL, temp)) {
+    char temp[RN4871_STATUS_MAX];
+    if (!command("G%", NULL, temp, sizeof(temp))) {
         return false;
     }
 
-    char *a = strtok(temp, ",");
-    char *b = strtok(NULL, ",");
-
-    if (a == NULL || b == NULL) {
+    char *comma = strchr(temp, ',');
+    if ((comma == NULL) || (comma == temp) || (comma[1] == 0)) {
         errno = ENOMSG;
         return false;
     }
+    *comma = 0;
 
     if (pre != NULL) {
-        strcpy(pre, a);
+        strcpy(pre, temp);
     }
 
     if (post != NULL) {
-        strcpy(post, b);
+        strcpy(post, comma + 1);
     }
     return true;
 }
 
 int RN4871::getAuthenticationMode() {
-    char buf[20];
-    if (command("GA", NULL, buf) == false) {
+    uint32_t mode;
+    if (!getCoded(AuthenticationMode, mode)) {
         return -1;
     }
-    return atoi(buf);
+    return mode;
 }
 
 uint32_t RN4871::getBaudRate() {
-    char buf[20];
-    if (command("GA", NULL, buf) == false) {
+    uint32_t baud;
+    if (!getCoded(BaudRate, baud)) {
         return 0;
     }
-    if (!strcasecmp(buf, "00")) return 921600;
-    if (!strcasecmp(buf, "01")) return 460800;
-    if (!strcasecmp(buf, "02")) return 230400;
-    if (!strcasecmp(buf, "03")) return 115200;
-    if (!strcasecmp(buf, "04")) return  57600;
-    if (!strcasecmp(buf, "05")) return  38400;
-    if (!strcasecmp(buf, "06")) return  28800;
-    if (!strcasecmp(buf, "07")) return  19200;
-    if (!strcasecmp(buf, "08")) return  14400;
-    if (!strcasecmp(buf, "09")) return   9600;
-    if (!strcasecmp(buf, "0A")) return   4800;
-    if (!strcasecmp(buf, "0B")) return   2400;
-    errno = EINVAL;
-    return 0;
+    return baud;
 }
 
 int RN4871::getBeacon() {
-    char buf[20];
-    if (command("GC", NULL, buf) == false) {
+    uint32_t mode;
+    if (!getCoded(BeaconMode, mode)) {
         return -1;
     }
-    return atoi(buf);
+    return mode;
 }
 
-bool RN4871::getPin(char *buf) {
-    return command("GP", NULL, buf);
+int RN4871::getAdvertisementPower() {
+    uint32_t p;
+    if (!getCoded(AdvertisementPower, p)) {
+        return -1;
+    }
+    return p;
+}
+
+int RN4871::getConnectedPower() {
+    uint32_t p;
+    if (!getCoded(ConnectedPower, p)) {
+        return -1;
+    }
+    return p;
+}
+
+bool RN4871::getPin(char *buf, size_t len) {
+    return command("GP", NULL, buf, len);
 }
 
 int RN4871::getFeatures() {
-    char buf[10];
-    if (!command("GR", NULL, buf)) {
+    char buf[RN4871_STATUS_MAX];
+    uint32_t v;
+    if (!command("GR", NULL, buf, sizeof(buf))) {
+        return -1;
+    }
+    if (!parseHex(buf, v)) {
+        errno = ENOMSG;
         return -1;
     }
-    return strtol(buf, NULL, 16);
+    return v;
 }
 
 int RN4871::getServices() {
-    char buf[10];
-    if (!command("GS", NULL, buf)) {
+    char buf[RN4871_STATUS_MAX];
+    uint32_t v;
+    if (!command("GS", NULL, buf, sizeof(buf))) {
         return -1;
     }
-    return strtol(buf, NULL, 16);
+    if (!parseHex(buf, v)) {
+        errno = ENOMSG;
+        return -1;
+    }
+    return v;
 }
 
 /* Action commands */
 
 bool RN4871::echoOn() {
-    char buf[20];
-    if (!command("+", NULL, buf)) {
+    char buf[RN4871_STATUS_MAX];
+    if (!command("+", NULL, buf, sizeof(buf))) {
         return false;
     }
     if (!strcasecmp(buf, "Echo OFF")) { 
         // It was already on, and we just turned it off, so turn it on again.
-        if (!command("+", NULL, buf)) {
+        if (!command("+", NULL, buf, sizeof(buf))) {
             return false;
         }
     }
@@ -371,13 +557,13 @@ bool RN4871::echoOn() {
 }
 
 bool RN4871::echoOff() {
-    char buf[20];
-    if (!command("+", NULL, buf)) {
+    char buf[RN4871_STATUS_MAX];
+    if (!command("+", NULL, buf, sizeof(buf))) {
         return false;
     }
     if (!strcasecmp(buf, "Echo ON")) { 
         // It was already off, and we just turned it on, so turn it off again.
-        if (!command("+", NULL, buf)) {
+        if (!command("+", NULL, buf, sizeof(buf))) {
             return false;
         }
     }
@@ -389,9 +575,11 @@ bool RN4871::advertise() {
 }
 
 bool RN4871::advertise(uint32_t interval, uint32_t period) {
-    char temp[40];
+    char temp[10];
     period /= 640;
-    sprintf(temp, "%04X,%04X", interval & 0xFFFF, period & 0xFFFF);
+    char *p = formatHex(temp, interval & 0xFFFF, 4);
+    *p++ = ',';
+    formatHex(p, period & 0xFFFF, 4);
     return command("A", temp);
 }
     
@@ -404,13 +592,195 @@ bool RN4871::connectLastBonded() {
 }
 
 bool RN4871::connect(const char *address) {
-    char temp[strlen(address) + 3];
-    sprintf(temp, "0,%s", address);
-    return command("C", temp);
+    return command("C", "0", address, NULL);
 }
 
 bool RN4871::reboot() {
     return command("R", "1");
 }
 
+/*! Drop the current connection. */
+bool RN4871::disconnect() {
+    return command("K", "1");
+}
+
+/*! Open the Transparent UART client on the peer we are connected to.
+ *
+ *  Used as a central. Once the module reports %STREAM_OPEN% and is put
+ *  into data mode, bytes written go to the peer and its replies can be
+ *  read back.
+ */
+bool RN4871::startClient() {
+    return command("CI", NULL);
+}
+
+/*! Start scanning for advertising devices.
+ *
+ *  Each device heard is reported as a status message; fetch them with
+ *  readScanResult() and stop the scan with stopScan().
+ */
+bool RN4871::startScan() {
+    return command("F", NULL);
+}
+
+bool RN4871::stopScan() {
+    return command("X", NULL);
+}
+
+/*! Read the next device reported by a scan.
+ *
+ *  The module reports %address,type,name,UUIDs,RSSI% with the name and
+ *  UUIDs left empty when the advert has none. Other status messages are
+ *  skipped. Returns false with errno set to EBUSY if nothing was heard
+ *  within timeout ms.
+ */
+bool RN4871::readScanResult(ScanResult &r, uint32_t timeout) {
+    char status[RN4871_STATUS_MAX];
+    uint32_t ts = millis();
+    while (millis() - ts < timeout) {
+        if (!readStatus(status, sizeof(status), timeout - (millis() - ts))) {
+            break;
+        }
+
+        char *fields[5];
+        int nfields = 0;
+        char *p = status;
+        fields[nfields++] = p;
+        while (*p && (nfields < 5)) {
+            if (*p == ',') {
+                *p = 0;
+                fields[nfields++] = p + 1;
+            }
+            p++;
+        }
+
+        if ((nfields < 3) || (strlen(fields[0]) != 12)) {
+            continue;
+        }
 
+        uint32_t type;
+        uint32_t rssi = 0;
+        if (!parseHex(fields[1], type) || ((nfields == 5) && !parseHex(fields[4], rssi))) {
+            continue;
+        }
+
+        strcpy(r.address, fields[0]);
+        r.addressType = type;
+        strncpy(r.name, fields[2], sizeof(r.name) - 1);
+        r.name[sizeof(r.name) - 1] = 0;
+        r.rssi = (int8_t)rssi;
+        return true;
+    }
+    errno = EBUSY;
+    return false;
+}
+
+/*! Ask the central to change the parameters of the current connection. */
+bool RN4871::updateConnectionParameters(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout) {
+    if (!validConnectionParameters(minInterval, maxInterval, latency, timeout)) {
+        errno = EINVAL;
+        return false;
+    }
+    char temp[20];
+    connectionArgs(temp, minInterval, maxInterval, latency, timeout);
+    return command("T", temp);
+}
+
+bool RN4871::updateConnectionParameters(const ConnectionProfile &p) {
+    return updateConnectionParameters(p.minInterval, p.maxInterval, p.latency, p.timeout);
+}
+
+/*! Put the module into dormant, its lowest power state.
+ *
+ *  Everything stops, including the radio, but the configuration is kept.
+ *  Only wake() brings it back, so a wake pin must be set first.
+ */
+bool RN4871::dormant() {
+    if (_wakePin < 0) {
+        errno = ENODEV;
+        return false;
+    }
+    if (!command("O", "0")) {
+        return false;
+    }
+    digitalWrite(_wakePin, HIGH);
+    return true;
+}
+
+
+
+
+/* Bulk transmit */
+
+#if defined(__PIC32MX__)
+/*! Send block writes through a DMA channel.
+ *
+ *  txreg is the transmit register of the UART behind the stream (U2TXREG
+ *  for Serial1 on the DSMini) and txirq its transmit interrupt request
+ *  (_UART2_TX_IRQ), which paces the channel one byte at a time.
+ */
+bool RN4871::attachDMA(DMAChannel &dma, volatile void *txreg, uint8_t txirq) {
+    if (!dma.begin()) {
+        errno = EBUSY;
+        return false;
+    }
+    _dma = &dma;
+    _txreg = txreg;
+    _txirq = txirq;
+    return true;
+}
+
+void RN4871::detachDMA() {
+    if (_dma != NULL) {
+        waitWrite();
+        _dma->end();
+        _dma = NULL;
+    }
+}
+#endif
+
+/*! Write a block of data and wait for it to go, as Print expects: the
+ *  caller may reuse or lose the buffer as soon as this returns. Long
+ *  blocks still go by DMA if a channel is attached.
+ */
+size_t RN4871::write(const uint8_t *buf, size_t len) {
+    size_t n = writeAsync(buf, len);
+    waitWrite();
+    return n;
+}
+
+/*! Write a block of data without waiting for it.
+ *
+ *  With a DMA channel attached, blocks of RN4871_DMA_MIN bytes or more are
+ *  handed to the channel and this returns straight away. The buffer then
+ *  belongs to the transfer until writeComplete() returns true, so it must
+ *  not be on the stack of a function that returns before then, nor be
+ *  changed meanwhile. Shorter blocks, and all blocks without DMA, are
+ *  written before this returns.
+ */
+size_t RN4871::writeAsync(const uint8_t *buf, size_t len) {
+    waitWrite();
+#if defined(__PIC32MX__)
+    if ((_dma != NULL) && (len >= RN4871_DMA_MIN)) {
+        // Let the serial driver finish anything it still has queued.
+        _dev->flush();
+        if (_dma->transfer(buf, len, _txreg, _txirq)) {
+            return len;
+        }
+    }
+#endif
+    return _dev->write(buf, len);
+}
+
+bool RN4871::writeComplete() {
+#if defined(__PIC32MX__)
+    if (_dma != NULL) {
+        return !_dma->busy();
+    }
+#endif
+    return true;
+}
+
+void RN4871::waitWrite() {
+    while (!writeComplete());
+}
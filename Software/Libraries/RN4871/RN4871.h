@@ -32,6 +32,19 @@
 #define _RN4871_H
 
 #include <Arduino.h>
+#include <Coroutine.h>
+#include <Format.h>
+#if defined(__PIC32MX__)
+#include <DMAChannel.h>
+#endif
+
+// writeAsync() blocks shorter than this are sent byte by byte. Anything at
+// least this long is handed to DMA and must stay valid until
+// writeComplete().
+#define RN4871_DMA_MIN 64
+
+// Longest status message kept, including scan results
+#define RN4871_STATUS_MAX 64
 
 class GAP {
     public:
@@ -150,9 +163,41 @@ class GAP {
 class RN4871 : public Stream {
     private:
         Stream *_dev;
+        int _wakePin;
+
+        // State of the command in progress
+        Coroutine _co;
+        char _line[RN4871_STATUS_MAX];
+        size_t _lpos;
+        uint32_t _ts;
+        bool _result;
+        int _errno;
+#if defined(__PIC32MX__)
+        DMAChannel *_dma;
+        volatile void *_txreg;
+        uint8_t _txirq;
+#endif
+
+        bool command(const char *command, const char *data, char *resp = NULL, size_t len = 0);
+        bool command(const char *command, const char *data, const char *data2, char *resp, size_t len = 0);
+        bool readStatus(char *buf, size_t len, uint32_t timeout);
+        void waitWrite();
+
+
+    public:
+        class CodedSetting;
+
+    private:
+        static const CodedSetting BaudRate;
+        static const CodedSetting AuthenticationMode;
+        static const CodedSetting BeaconMode;
+        static const CodedSetting AdvertisementPower;
+        static const CodedSetting ConnectedPower;
+        static const CodedSetting PinNumber;
+        static const CodedSetting PinFunction;
 
-        bool command(const char *command, const char *data, char *resp = NULL);
-        
+        bool setCoded(const CodedSetting &s, uint32_t value);
+        bool getCoded(const CodedSetting &s, uint32_t &value);
 
     public:
 
@@ -179,17 +224,58 @@ class RN4871 : public Stream {
                 static const uint16_t MLDPStreaming     = 0x0020;
         };
 
-        RN4871(Stream *dev) : _dev(dev) {}
-        RN4871(Stream &dev) : _dev(&dev) {}
+        /* Connection parameters. Intervals are in 1.25ms units, the
+         * supervision timeout in 10ms units, and latency is the number
+         * of connection events the module may skip when it has nothing
+         * to send.
+         */
+        class ConnectionProfile {
+            public:
+                uint16_t minInterval;
+                uint16_t maxInterval;
+                uint16_t latency;
+                uint16_t timeout;
+        };
+
+        /* One device heard while scanning */
+        class ScanResult {
+            public:
+                char address[13];
+                uint8_t addressType;
+                char name[21];
+                int8_t rssi;
+        };
+
+        // Short interval, no latency: for bulk transfers
+        static const ConnectionProfile Burst;
+        // Long interval with slave latency: for links that sit mostly idle
+        static const ConnectionProfile Idle;
+
+#if defined(__PIC32MX__)
+        RN4871(Stream *dev) : _dev(dev), _wakePin(-1), _result(false), _dma(NULL) {}
+        RN4871(Stream &dev) : _dev(&dev), _wakePin(-1), _result(false), _dma(NULL) {}
+
+        bool attachDMA(DMAChannel &dma, volatile void *txreg, uint8_t txirq);
+        void detachDMA();
+#else
+        RN4871(Stream *dev) : _dev(dev), _wakePin(-1), _result(false) {}
+        RN4871(Stream &dev) : _dev(&dev), _wakePin(-1), _result(false) {}
+#endif
 
         bool enterCommandMode();
         bool enterDataMode();
         bool begin();
+        bool commandTask(const char *command, const char *data, const char *data2, char *resp, size_t len);
+        bool commandResult() { return _result; }
+        bool waitForBoot(uint32_t timeout);
+        bool waitForStatus(const char *event, uint32_t timeout);
+        void setWakePin(int pin);
+        bool wake(uint32_t timeout);
 
         bool setSerializedDeviceName(const char *name);
         bool setCommandModeCharacter(const char *character);
         bool setDelimiters(const char *pre, const char *post);
-        bool setNVM(int address, const char *hex);
+        bool setNVM(int address, const char *data);
         bool setAuthenticationMode(int mode);
         bool setBaudRate(uint32_t baud);
         bool setBeacon(int mode);
@@ -208,17 +294,22 @@ class RN4871 : public Stream {
         bool setFeatures(uint16_t bitmap);
         bool setServices(uint8_t bitmap);
         bool setPinFunction(int pin, int function);
+        bool setConnectionParameters(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout);
+        bool setConnectionParameters(const ConnectionProfile &p);
+        bool setLowPower(bool on);
 
-        bool getNVM(int address, int len, char *buf);
-        bool getConnectionStatus(char *buf);
-        bool getPeerDeviceName(char *buf);
-        bool getSerializedDeviceName(char *buf);
+        bool getNVM(int address, int len, char *buf, size_t buflen = RN4871_STATUS_MAX);
+        bool getConnectionStatus(char *buf, size_t len = RN4871_STATUS_MAX);
+        bool getPeerDeviceName(char *buf, size_t len = RN4871_STATUS_MAX);
+        bool getSerializedDeviceName(char *buf, size_t len = RN4871_STATUS_MAX);
         char getCommandModeCharacter();
         bool getDelimiters(char *pre, char *post);
         int getAuthenticationMode();
         uint32_t getBaudRate();
         int getBeacon();
-        bool getPin(char *buf);
+        int getAdvertisementPower();
+        int getConnectedPower();
+        bool getPin(char *buf, size_t len = RN4871_STATUS_MAX);
         int getFeatures();
         int getServices();
         bool echoOn();
@@ -229,12 +320,23 @@ class RN4871 : public Stream {
         bool connectLastBonded();
         bool connect(const char *address);
         bool reboot();
+        bool disconnect();
+        bool startClient();
+        bool startScan();
+        bool stopScan();
+        bool readScanResult(ScanResult &r, uint32_t timeout);
+        bool updateConnectionParameters(uint16_t minInterval, uint16_t maxInterval, uint16_t latency, uint16_t timeout);
+        bool updateConnectionParameters(const ConnectionProfile &p);
+        bool dormant();
 
-        size_t write(uint8_t c) { return _dev->write(c); }
+        size_t write(uint8_t c) { waitWrite(); return _dev->write(c); }
+        size_t write(const uint8_t *buf, size_t len);
+        size_t writeAsync(const uint8_t *buf, size_t len);
+        bool writeComplete();
         int read() { return _dev->read(); }
         int available() { return _dev->available(); }
         int peek() { return _dev->peek(); }
-        void flush() { _dev->flush(); }
+        void flush() { waitWrite(); _dev->flush(); }
 
 };
 
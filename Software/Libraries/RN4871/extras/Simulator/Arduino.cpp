@@ -0,0 +1,46 @@
+#include <Arduino.h>
+
+static uint64_t now = 0;
+static uint8_t pins[32];
+
+uint64_t simNow() {
+    return now;
+}
+
+void simAdvance(uint64_t us) {
+    now += us;
+}
+
+void simAdvanceTo(uint64_t us) {
+    if (us > now) {
+        now = us;
+    }
+}
+
+uint32_t millis() {
+    return now / 1000;
+}
+
+uint32_t micros() {
+    return now;
+}
+
+void delay(uint32_t ms) {
+    now += (uint64_t)ms * 1000;
+}
+
+void pinMode(uint8_t, uint8_t) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+    if (pin < sizeof(pins)) {
+        pins[pin] = val;
+    }
+}
+
+int digitalRead(uint8_t pin) {
+    if (pin < sizeof(pins)) {
+        return pins[pin];
+    }
+    return LOW;
+}
@@ -0,0 +1,71 @@
+/*
+ * Minimal host-side stand in for the chipKIT core, just enough to build
+ * the RN4871 library on Linux. Time is virtual: millis() and delay() run
+ * on a simulated clock which the module simulator advances.
+ */
+
+#ifndef _ARDUINO_H
+#define _ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#ifndef min
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#endif
+
+#define LOW     0
+#define HIGH    1
+#define INPUT   0
+#define OUTPUT  1
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+uint32_t millis();
+uint32_t micros();
+void delay(uint32_t ms);
+
+// Simulated clock, in microseconds
+uint64_t simNow();
+void simAdvance(uint64_t us);
+void simAdvanceTo(uint64_t us);
+
+class Print {
+    public:
+        virtual ~Print() {}
+        virtual size_t write(uint8_t c) = 0;
+        virtual size_t write(const uint8_t *buf, size_t len) {
+            size_t n = 0;
+            while (len--) {
+                n += write(*buf++);
+            }
+            return n;
+        }
+        size_t write(const char *str) {
+            return write((const uint8_t *)str, strlen(str));
+        }
+        size_t print(const char *str) { return write(str); }
+        size_t print(char c) { return write((uint8_t)c); }
+        size_t print(int v) {
+            char temp[12];
+            snprintf(temp, sizeof(temp), "%d", v);
+            return write(temp);
+        }
+        size_t println(const char *str) { return print(str) + print("\r\n"); }
+};
+
+class Stream : public Print {
+    public:
+        virtual int available() = 0;
+        virtual int read() = 0;
+        virtual int peek() = 0;
+        virtual void flush() = 0;
+};
+
+#endif
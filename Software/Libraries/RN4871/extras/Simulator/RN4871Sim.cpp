@@ -0,0 +1,496 @@
+#include <RN4871Sim.h>
+
+// How long the host spends on one poll of an empty receive buffer
+#define POLL_TIME 5
+
+// Depth of the UART transmit FIFO on the host side
+#define TX_FIFO 8
+
+#define FEATURE_NO_PROMPT 0x4000
+
+RN4871Sim::RN4871Sim(uint32_t baud) : _baud(baud) {
+    _rxFree = 0;
+    _txFree = 0;
+    _powered = false;
+    _dormant = false;
+    _wakePin = -1;
+    _commandMode = false;
+    _connected = false;
+    _dollars = 0;
+    _peerFree = 0;
+    _peerBytes = 0;
+    _remote = -1;
+    _stream = false;
+    defaults();
+}
+
+void RN4871Sim::defaults() {
+    _settings.clear();
+    _settings["S-"] = "RN4871";
+    _settings["SN"] = "RN4871-5A3C";
+    _settings["SA"] = "2";
+    _settings["SB"] = "03";
+    _settings["SC"] = "0";
+    _settings["SS"] = "C0";
+    _settings["SR"] = "0000";
+    _settings["S$"] = "$";
+    _settings["S%"] = "%,%";
+    _settings["SP"] = "123456";
+    _settings["SGA"] = "0";
+    _settings["SGC"] = "0";
+    _settings["SO"] = "0";
+    _settings["ST"] = "0010,0020,0000,0200";
+    _interval = 0x0018;
+}
+
+// Each connection event carries a few packets of payload
+uint64_t RN4871Sim::perByte() {
+    return (uint64_t)_interval * 1250 / (PayloadSize * PacketsPerEvent);
+}
+
+uint32_t RN4871Sim::byteTime() {
+    return 10000000UL / _baud;
+}
+
+/* Line level */
+
+void RN4871Sim::send(uint64_t at, const char *txt) {
+    send(at, (const uint8_t *)txt, strlen(txt));
+}
+
+void RN4871Sim::send(uint64_t at, const uint8_t *data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        uint64_t t = (at > _txFree ? at : _txFree) + byteTime();
+        _txFree = t;
+        timedByte b = { t, data[i] };
+        _out.push_back(b);
+    }
+}
+
+void RN4871Sim::reply(uint64_t at, const char *txt) {
+    send(at, txt);
+    send(at, "\r\n");
+    prompt(at);
+}
+
+void RN4871Sim::prompt(uint64_t at) {
+    if (!_commandMode) {
+        return;
+    }
+    if (strtol(_settings["SR"].c_str(), NULL, 16) & FEATURE_NO_PROMPT) {
+        return;
+    }
+    send(at, "CMD> ");
+}
+
+void RN4871Sim::rebootAt(uint64_t at) {
+    _commandMode = false;
+    _connected = false;
+    _remote = -1;
+    _stream = false;
+    _dollars = 0;
+    _line.clear();
+    _rxFree = at;
+    send(at, "%REBOOT%");
+}
+
+void RN4871Sim::powerOn() {
+    _powered = true;
+    _dormant = false;
+    _out.clear();
+    _txFree = simNow();
+    rebootAt(simNow() + BootTime);
+}
+
+void RN4871Sim::powerOff() {
+    _powered = false;
+    _dormant = false;
+    _commandMode = false;
+    _connected = false;
+    _remote = -1;
+    _stream = false;
+    _out.clear();
+}
+
+/* Module side */
+
+// Dormant ends with a reboot once UART_RX_IND is pulled low
+void RN4871Sim::checkWake() {
+    if (_dormant && (_wakePin >= 0) && (digitalRead(_wakePin) == LOW)) {
+        _dormant = false;
+        rebootAt(simNow() + WakeTime);
+    }
+}
+
+void RN4871Sim::receive(uint64_t at, uint8_t c) {
+    if (!_powered || _dormant) {
+        return;
+    }
+
+    if (!_commandMode) {
+        if (c == '$') {
+            if (++_dollars == 3) {
+                _dollars = 0;
+                _commandMode = true;
+                _line.clear();
+                prompt(at + ActionTime);
+                return;
+            }
+        } else {
+            _dollars = 0;
+        }
+        if (_connected) {
+            _peerFree = (at > _peerFree ? at : _peerFree) + perByte();
+            _peerBytes++;
+            if ((_remote >= 0) && _stream && (_remotes[_remote].handler != NULL)) {
+                _remotes[_remote].handler(*this, _remotes[_remote].ctx, _peerFree, c);
+            }
+        }
+        return;
+    }
+
+    if (c == '\n') {
+        return;
+    }
+    if (c != '\r') {
+        _line += (char)c;
+        return;
+    }
+    std::string cmd = _line;
+    _line.clear();
+    execute(at, cmd);
+}
+
+static bool isHex(const std::string &s, size_t len) {
+    if (s.length() != len) {
+        return false;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (!isxdigit((unsigned char)s[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Four comma separated 16 bit hex fields, as taken by ST and T
+static bool connectionParameters(const std::string &s, uint16_t *interval) {
+    if (s.length() != 19) {
+        return false;
+    }
+    for (int i = 0; i < 4; i++) {
+        if ((i > 0) && (s[i * 5 - 1] != ',')) {
+            return false;
+        }
+        if (!isHex(s.substr(i * 5, 4), 4)) {
+            return false;
+        }
+    }
+    if (interval != NULL) {
+        *interval = strtol(s.substr(0, 4).c_str(), NULL, 16);
+    }
+    return true;
+}
+
+static bool inRange(const std::string &s, long lo, long hi) {
+    if (s.empty()) {
+        return false;
+    }
+    char *end;
+    long v = strtol(s.c_str(), &end, 16);
+    return (*end == 0) && (v >= lo) && (v <= hi);
+}
+
+bool RN4871Sim::setting(const std::string &cmd, const std::string &args) {
+    if (cmd == "SB") return isHex(args, 2) && inRange(args, 0x00, 0x0B);
+    if (cmd == "SA") return inRange(args, 1, 4);
+    if (cmd == "SC") return inRange(args, 0, 2);
+    if (cmd == "SGA" || cmd == "SGC") return inRange(args, 0, 5);
+    if (cmd == "SO") return inRange(args, 0, 1);
+    if (cmd == "SS") return isHex(args, 2);
+    if (cmd == "SR") return isHex(args, 4);
+    if (cmd == "SDA") return isHex(args, 4);
+    if (cmd == "SW") {
+        return (args.length() == 5) && (args[2] == ',') &&
+            inRange(args.substr(0, 2), 0x0A, 0x0D) &&
+            inRange(args.substr(3, 2), 0x00, 0x0C);
+    }
+    if (cmd == "ST") return connectionParameters(args, NULL);
+    if (cmd == "S-") return !args.empty() && args.length() <= 15;
+    if (cmd == "SN") return !args.empty() && args.length() <= 20;
+    if (cmd == "SP") return args.length() >= 4 && args.length() <= 6;
+    if (cmd == "SDF" || cmd == "SDM" || cmd == "SDN" || cmd == "SDR" ||
+        cmd == "SDH" || cmd == "SDS" || cmd == "S$" || cmd == "S%" ||
+        cmd == "S:") {
+        return !args.empty();
+    }
+    return false;
+}
+
+void RN4871Sim::execute(uint64_t at, const std::string &line) {
+    if (line == "---") {
+        _commandMode = false;
+        send(at + ActionTime, "END\r\n");
+        return;
+    }
+
+    size_t comma = line.find(',');
+    std::string cmd = line.substr(0, comma);
+    std::string args = (comma == std::string::npos) ? "" : line.substr(comma + 1);
+
+    if (cmd.empty()) {
+        reply(at + ActionTime, "Err");
+        return;
+    }
+
+    if (cmd[0] == 'S') {
+        at += SetTime;
+        if (cmd == "SF") {
+            if (args != "1" && args != "2") {
+                reply(at, "Err");
+                return;
+            }
+            defaults();
+            send(at, "Reboot after Factory Reset\r\n");
+            rebootAt(at + FactoryTime);
+            return;
+        }
+        if (!setting(cmd, args)) {
+            reply(at, "Err");
+            return;
+        }
+        _settings[cmd] = args;
+        reply(at, "AOK");
+        return;
+    }
+
+    if (cmd[0] == 'G') {
+        at += GetTime;
+        if (cmd == "GK") {
+            reply(at, _connected ? "001EC0123456,0,1" : "none");
+            return;
+        }
+        if (cmd == "GNR") {
+            reply(at, _connected ? "Peer" : "Err");
+            return;
+        }
+        std::map<std::string, std::string>::iterator i = _settings.find("S" + cmd.substr(1));
+        if (i == _settings.end()) {
+            reply(at, "Err");
+            return;
+        }
+        reply(at, i->second.c_str());
+        return;
+    }
+
+    at += ActionTime;
+
+    if (cmd == "+") {
+        static bool echo = false;
+        echo = !echo;
+        reply(at, echo ? "Echo ON" : "Echo OFF");
+        return;
+    }
+
+    if (cmd == "R") {
+        if (args != "1") {
+            reply(at, "Err");
+            return;
+        }
+        send(at, "Rebooting\r\n");
+        rebootAt(at + RebootTime);
+        return;
+    }
+
+    if (cmd == "O") {
+        if (args != "0") {
+            reply(at, "Err");
+            return;
+        }
+        send(at, "AOK\r\n");
+        _commandMode = false;
+        _connected = false;
+        _dormant = true;
+        return;
+    }
+
+    if (cmd == "K") {
+        if (!_connected) {
+            reply(at, "Err");
+            return;
+        }
+        reply(at, "AOK");
+        _connected = false;
+        _remote = -1;
+        _stream = false;
+        send(at, "%DISCONNECT%");
+        return;
+    }
+
+    if (cmd == "F") {
+        // Duplicates are filtered, so each remote is reported once
+        reply(at, "Scanning");
+        for (size_t i = 0; i < _remotes.size(); i++) {
+            std::string ev = "%" + _remotes[i].address + ",0," + _remotes[i].name + ",,C3%";
+            send(at + (i + 1) * AdvertTime, ev.c_str());
+        }
+        return;
+    }
+
+    if (cmd == "X") {
+        reply(at, "AOK");
+        return;
+    }
+
+    if (cmd == "CI") {
+        if ((_remote < 0) || _stream) {
+            reply(at, "Err");
+            return;
+        }
+        reply(at, "AOK");
+        _stream = true;
+        send(at + ConnectTime, "%STREAM_OPEN%");
+        return;
+    }
+
+    if ((cmd == "C") && !args.empty()) {
+        // Only a remote that is in range ever answers
+        reply(at, "Trying");
+        if (_connected || (args.substr(0, 2) != "0," && args.substr(0, 2) != "1,")) {
+            return;
+        }
+        for (size_t i = 0; i < _remotes.size(); i++) {
+            if (_remotes[i].address == args.substr(2)) {
+                _remote = i;
+                _connected = true;
+                connectionParameters(_settings["ST"], &_interval);
+                _peerFree = at + ConnectTime;
+                std::string ev = "%CONNECT,1," + _remotes[i].address + "%";
+                send(at + ConnectTime, ev.c_str());
+            }
+        }
+        return;
+    }
+
+    if (cmd == "T") {
+        // The central grants the shortest interval asked for
+        if (!_connected || !connectionParameters(args, &_interval)) {
+            reply(at, "Err");
+            return;
+        }
+        reply(at, "AOK");
+        return;
+    }
+
+    if (cmd == "A" || cmd == "B" || cmd == "C" || cmd == "Y") {
+        reply(at, "AOK");
+        return;
+    }
+
+    reply(at, "Err");
+}
+
+const char *RN4871Sim::get(const char *cmd) {
+    std::map<std::string, std::string>::iterator i = _settings.find(cmd);
+    if (i == _settings.end()) {
+        return NULL;
+    }
+    return i->second.c_str();
+}
+
+/* Peer side */
+
+void RN4871Sim::peerConnect(const char *address) {
+    if (!_powered) {
+        return;
+    }
+    _connected = true;
+    connectionParameters(_settings["ST"], &_interval);
+    _peerFree = simNow();
+    std::string ev = "%CONNECT,0,";
+    ev += address;
+    ev += "%";
+    send(simNow(), ev.c_str());
+}
+
+void RN4871Sim::peerDisconnect() {
+    if (!_connected) {
+        return;
+    }
+    _connected = false;
+    send(simNow(), "%DISCONNECT%");
+}
+
+void RN4871Sim::peerSend(const char *data) {
+    peerSend(simNow(), (const uint8_t *)data, strlen(data));
+}
+
+void RN4871Sim::peerSend(uint64_t at, const uint8_t *data, size_t len) {
+    if (!_connected) {
+        return;
+    }
+    uint64_t t = at;
+    for (size_t i = 0; i < len; i++) {
+        t += perByte();
+        send(t, &data[i], 1);
+    }
+}
+
+void RN4871Sim::addRemote(const char *address, const char *name, remoteHandler handler, void *ctx) {
+    remote r;
+    r.address = address;
+    r.name = name;
+    r.handler = handler;
+    r.ctx = ctx;
+    _remotes.push_back(r);
+}
+
+/* Host side, as seen through Serial1 */
+
+size_t RN4871Sim::write(uint8_t c) {
+    // The host blocks once its transmit FIFO is full
+    uint64_t backlog = TX_FIFO * byteTime();
+    if (_rxFree > simNow() + backlog) {
+        simAdvanceTo(_rxFree - backlog);
+    }
+    uint64_t t = (simNow() > _rxFree ? simNow() : _rxFree) + byteTime();
+    _rxFree = t;
+    receive(t, c);
+    return 1;
+}
+
+int RN4871Sim::available() {
+    checkWake();
+    int n = 0;
+    for (std::deque<timedByte>::iterator i = _out.begin(); i != _out.end(); i++) {
+        if (i->time > simNow()) {
+            break;
+        }
+        n++;
+    }
+    if (n == 0) {
+        simAdvance(POLL_TIME);
+    }
+    return n;
+}
+
+int RN4871Sim::peek() {
+    checkWake();
+    if (_out.empty() || (_out.front().time > simNow())) {
+        simAdvance(POLL_TIME);
+        return -1;
+    }
+    return _out.front().c;
+}
+
+int RN4871Sim::read() {
+    int c = peek();
+    if (c >= 0) {
+        _out.pop_front();
+    }
+    return c;
+}
+
+void RN4871Sim::flush() {
+    simAdvanceTo(_rxFree);
+}
@@ -0,0 +1,120 @@
+#ifndef _RN4871SIM_H
+#define _RN4871SIM_H
+
+// The standard headers must come before Arduino.h defines min()
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+#include <Arduino.h>
+
+/*
+ * Simulated RN4871 module on the far end of a UART.
+ *
+ * The host side talks to it through the Stream interface exactly as the
+ * firmware talks to Serial1. Bytes travel at the configured baud rate on
+ * the virtual clock, commands are answered after a per-command processing
+ * delay, and data sent while connected is delivered to a simulated peer
+ * at a rate set by the BLE connection interval.
+ *
+ * Other devices in range can be added with addRemote(). They show up in
+ * scans, and once connected to as a central with the Transparent UART
+ * client open, each data byte reaching one is passed to its handler.
+ */
+class RN4871Sim;
+
+typedef void (*remoteHandler)(RN4871Sim &sim, void *ctx, uint64_t at, uint8_t c);
+
+class RN4871Sim : public Stream {
+    private:
+        typedef struct {
+            std::string address;
+            std::string name;
+            remoteHandler handler;
+            void *ctx;
+        } remote;
+
+        typedef struct {
+            uint64_t time;
+            uint8_t c;
+        } timedByte;
+
+        uint32_t _baud;
+        uint64_t _rxFree;       // When the line into the module is next idle
+        uint64_t _txFree;       // When the line out of the module is next idle
+        std::deque<timedByte> _out;
+
+        bool _powered;
+        bool _dormant;
+        int _wakePin;
+        bool _commandMode;
+        bool _connected;
+        int _dollars;
+        std::string _line;
+        std::map<std::string, std::string> _settings;
+
+        uint16_t _interval;     // Connection interval in 1.25ms units
+        uint64_t _peerFree;     // When the link can next carry peer data
+        size_t _peerBytes;
+
+        std::vector<remote> _remotes;
+        int _remote;            // Remote we are central to, or -1
+        bool _stream;           // Transparent UART client open
+
+        uint32_t byteTime();
+        void send(uint64_t at, const char *txt);
+        void send(uint64_t at, const uint8_t *data, size_t len);
+        void reply(uint64_t at, const char *txt);
+        void prompt(uint64_t at);
+        void rebootAt(uint64_t at);
+        void receive(uint64_t at, uint8_t c);
+        void execute(uint64_t at, const std::string &cmd);
+        bool setting(const std::string &cmd, const std::string &args);
+        void defaults();
+        void checkWake();
+        uint64_t perByte();
+
+    public:
+        // Processing time of the module, in microseconds
+        static const uint32_t BootTime      = 55000;
+        static const uint32_t SetTime       = 1500;
+        static const uint32_t GetTime       = 1000;
+        static const uint32_t ActionTime    = 3000;
+        static const uint32_t RebootTime    = 75000;
+        static const uint32_t WakeTime      = 8000;
+        static const uint32_t FactoryTime   = 250000;
+        static const uint32_t AdvertTime    = 100000;
+        static const uint32_t ConnectTime   = 30000;
+        static const uint32_t PayloadSize   = 20;
+        static const uint32_t PacketsPerEvent = 4;
+
+        RN4871Sim(uint32_t baud = 115200);
+
+        void powerOn();
+        void powerOff();
+        void setWakePin(int pin) { _wakePin = pin; }
+        bool isDormant() { return _dormant; }
+
+        // Peer side of the link
+        void peerConnect(const char *address);
+        void peerDisconnect();
+        void peerSend(const char *data);
+        void peerSend(uint64_t at, const uint8_t *data, size_t len);
+        size_t peerReceived() { return _peerBytes; }
+        uint64_t peerIdle() { return _peerFree; }
+
+        // Other devices in range
+        void addRemote(const char *address, const char *name, remoteHandler handler, void *ctx);
+
+        bool inCommandMode() { return _commandMode; }
+        bool connected() { return _connected; }
+        const char *get(const char *cmd);
+
+        size_t write(uint8_t c);
+        int available();
+        int read();
+        int peek();
+        void flush();
+};
+
+#endif
@@ -0,0 +1,304 @@
+/*
+ * Runs the RN4871 library against the simulated module and reports
+ * how long the boot configuration takes, how fast data moves through
+ * the Transparent UART, whether each command round-trips correctly,
+ * whether a gateway collects the right samples from simulated peers, and
+ * whether the Format helpers the protocol relies on give the right text.
+ *
+ * Exits non-zero if any check fails, whether on the module, the Format
+ * helpers or the gateway.
+ */
+
+#include <RN4871Sim.h>
+#include <RN4871.h>
+#include <Gateway.h>
+#include <Format.h>
+
+RN4871Sim module;
+RN4871 BLE(module);
+
+static int failures = 0;
+
+static void check(const char *what, bool ok) {
+    printf("  %-44s %s\n", what, ok ? "ok" : "FAIL");
+    if (!ok) {
+        failures++;
+    }
+}
+
+static bool is(const char *cmd, const char *val) {
+    const char *v = module.get(cmd);
+    return (v != NULL) && !strcmp(v, val);
+}
+
+static void bootConfiguration() {
+    printf("Boot configuration (as initRF())\n");
+    module.powerOn();
+    uint64_t start = simNow();
+    check("boot banner", BLE.waitForBoot(1000));
+    BLE.begin();
+    BLE.enterCommandMode();
+    BLE.factoryReset();
+    check("factory reset banner", BLE.waitForBoot(1000));
+    BLE.enterCommandMode();
+    BLE.setSerializedDeviceName("DSMini");
+    BLE.setFeatures(RN4871::Feature::NoPrompt);
+    BLE.setServices(RN4871::Service::DIS | RN4871::Service::TransparentUART);
+    BLE.setDISAppearance(GAP::Thermometer::Generic);
+    BLE.setDISFirmwareRevision("1.0");
+    BLE.setDISSoftwareRevision("1.0");
+    BLE.setDISHardwareRevision("0.2Beta");
+    BLE.setDISModelName("DSMini");
+    BLE.setDISManufacturer("Majenko Technologies");
+    BLE.setDISSerialNumber("1");
+    BLE.reboot();
+    check("reboot banner", BLE.waitForBoot(1000));
+    printf("  %-44s %llu ms\n", "total", (unsigned long long)(simNow() - start) / 1000);
+    check("configuration stored", is("S-", "DSMini") && is("SS", "C0") && is("SR", "4000"));
+}
+
+static void commands() {
+    printf("Commands\n");
+    module.powerOn();
+    delay(100);
+    BLE.enterCommandMode();
+
+    check("setServices", BLE.setServices(0xC0) && is("SS", "C0"));
+    check("getServices", BLE.getServices() == 0xC0);
+    check("setFeatures", BLE.setFeatures(0x4000) && is("SR", "4000"));
+    check("getFeatures", BLE.getFeatures() == 0x4000);
+    check("setBaudRate", BLE.setBaudRate(115200) && is("SB", "03"));
+    check("getBaudRate", BLE.getBaudRate() == 115200);
+    check("setBaudRate rejects bad rate", !BLE.setBaudRate(1234));
+    check("setAuthenticationMode", BLE.setAuthenticationMode(3) && is("SA", "3"));
+    check("getAuthenticationMode", BLE.getAuthenticationMode() == 3);
+    check("setBeacon", BLE.setBeacon(1) && is("SC", "1"));
+    check("getBeacon", BLE.getBeacon() == 1);
+    check("setAdvertisementPower", BLE.setAdvertisementPower(3) && is("SGA", "3"));
+    check("setConnectedPower", BLE.setConnectedPower(5) && is("SGC", "5"));
+    check("setAdvertisementPower rejects bad level", !BLE.setAdvertisementPower(6));
+    check("getAdvertisementPower", BLE.getAdvertisementPower() == 3);
+    check("getConnectedPower", BLE.getConnectedPower() == 5);
+    check("setPinFunction", BLE.setPinFunction(13, 0x0C) && is("SW", "0B,0C"));
+    check("setPinFunction rejects bad pin", !BLE.setPinFunction(14, 0x01));
+    check("setNVM", BLE.setNVM(0x100, "0102") && is("S:", "0100,0102"));
+    check("setDISAppearance", BLE.setDISAppearance(GAP::Thermometer::Generic) && is("SDA", "0300"));
+    check("setDelimiters", BLE.setDelimiters("[", "]") && is("S%", "[,]"));
+
+    char pre[4], post[4];
+    check("getDelimiters", BLE.getDelimiters(pre, post) && !strcmp(pre, "[") && !strcmp(post, "]"));
+    BLE.setDelimiters("%", "%");
+
+    char buf[40];
+    check("getSerializedDeviceName", BLE.getSerializedDeviceName(buf) && !strcmp(buf, "DSMini"));
+    check("getConnectionStatus", BLE.getConnectionStatus(buf) && !strcmp(buf, "none"));
+    char small[4];
+    check("reply cut to the buffer", BLE.getSerializedDeviceName(small, sizeof(small)) && !strcmp(small, "DSM"));
+    check("module error reported", !BLE.setPin("12"));
+
+    int polls = 0;
+    while (!BLE.commandTask("GS", NULL, NULL, buf, sizeof(buf))) {
+        polls++;
+    }
+    check("commandTask yields while waiting", (polls > 0) && BLE.commandResult() && !strcmp(buf, "C0"));
+    check("echoOn", BLE.echoOn());
+    check("echoOff", BLE.echoOff());
+    check("advertise", BLE.advertise());
+    check("setConnectionParameters", BLE.setConnectionParameters(RN4871::Idle) && is("ST", "0140,0190,0004,0258"));
+    check("setConnectionParameters rejects bad timeout", !BLE.setConnectionParameters(6, 12, 10, 10));
+    check("updateConnectionParameters needs a link", !BLE.updateConnectionParameters(RN4871::Burst));
+    BLE.enterDataMode();
+}
+
+static void transfer(const char *profile, const RN4871::ConnectionProfile &p) {
+    static uint8_t data[4096];
+
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = 'A' + (i % 26);
+    }
+
+    BLE.enterCommandMode();
+    char what[40];
+    sprintf(what, "%s profile", profile);
+    check(what, BLE.updateConnectionParameters(p));
+    BLE.enterDataMode();
+    delay(10);
+
+    size_t before = module.peerReceived();
+    uint64_t start = simNow();
+    BLE.write(data, sizeof(data));
+    uint64_t cpu = simNow() - start;
+    BLE.flush();
+    uint64_t link = module.peerIdle() - start;
+
+    printf("  %-44s %llu ms\n", "CPU busy writing 4 KiB", (unsigned long long)cpu / 1000);
+    printf("  %-44s %llu ms (%llu B/s)\n", "delivered to peer",
+        (unsigned long long)link / 1000,
+        (unsigned long long)(sizeof(data) * 1000000ULL / link));
+    check("all bytes delivered", module.peerReceived() - before == sizeof(data));
+}
+
+static void throughput() {
+    printf("Transparent UART throughput\n");
+    module.powerOn();
+    delay(100);
+    module.peerConnect("001EC0123456");
+    check("connect status", BLE.waitForStatus("CONNECT", 100));
+
+    transfer("Burst", RN4871::Burst);
+    transfer("Idle", RN4871::Idle);
+
+    module.peerDisconnect();
+    check("disconnect status", BLE.waitForStatus("DISCONNECT", 100));
+}
+
+static void dormant() {
+    printf("Dormant and wake\n");
+    module.powerOn();
+    check("cold boot", BLE.waitForBoot(1000));
+
+    BLE.enterCommandMode();
+    check("dormant needs a wake pin", !BLE.dormant());
+    BLE.setWakePin(3);
+    module.setWakePin(3);
+    check("setLowPower", BLE.setLowPower(true) && is("SO", "1"));
+    check("dormant", BLE.dormant() && module.isDormant());
+
+    uint64_t start = simNow();
+    check("wake", BLE.wake(1000) && !module.isDormant());
+    printf("  %-44s %llu ms\n", "wake to ready", (unsigned long long)(simNow() - start) / 1000);
+    BLE.setWakePin(-1);
+    module.setWakePin(-1);
+}
+
+static void formatting() {
+    printf("Formatting\n");
+    char buf[32];
+    uint32_t v;
+
+    formatFixed(buf, 2325, 2, 4);
+    check("formatFixed", !strcmp(buf, "23.25"));
+    formatFixed(buf, -50, 2);
+    check("formatFixed negative below one", !strcmp(buf, "-0.50"));
+    formatFixed(buf, 7, 0, 3);
+    check("formatFixed pads to width", !strcmp(buf, "  7"));
+    formatFixed(buf, INT32_MIN, FORMAT_MAX_DECIMALS);
+    check("formatFixed longest", !strcmp(buf, "-2.147483648"));
+    check("formatFixed rejects too many decimals",
+          (formatFixed(buf, 1, FORMAT_MAX_DECIMALS + 1) == buf) && (buf[0] == 0));
+    formatTime(buf, 0x12345600);
+    check("formatTime", !strcmp(buf, "12:34:56"));
+    check("parseHex", parseHex("C0", v) && (v == 0xC0));
+    check("parseHex lower case", parseHex("1f", v) && (v == 0x1F));
+    check("parseHex rejects empty", !parseHex("", v));
+    check("parseHex rejects junk", !parseHex("12G", v));
+}
+
+// A peer DSMini as seen from the gateway: answers the wake byte and the
+// history request the way the sketch does.
+typedef struct {
+    uint32_t total;
+    uint16_t count;
+    float samples[GATEWAY_MAX_SAMPLES];
+    bool asleep;
+} simPeer;
+
+static void addSample(simPeer &p, float t) {
+    if (p.count == GATEWAY_MAX_SAMPLES) {
+        memmove(p.samples, p.samples + 1, sizeof(float) * (GATEWAY_MAX_SAMPLES - 1));
+        p.count--;
+    }
+    p.samples[p.count++] = t;
+    p.total++;
+}
+
+static void peerHandler(RN4871Sim &sim, void *ctx, uint64_t at, uint8_t c) {
+    simPeer *p = (simPeer *)ctx;
+    if (p->asleep) {
+        // The byte that wakes it is lost
+        p->asleep = false;
+        uint8_t ready = GATEWAY_READY;
+        sim.peerSend(at + 2000, &ready, 1);
+        return;
+    }
+    if (c == GATEWAY_HISTORY) {
+        uint8_t header[6] = {
+            (uint8_t)p->total, (uint8_t)(p->total >> 8), (uint8_t)(p->total >> 16), (uint8_t)(p->total >> 24),
+            (uint8_t)p->count, (uint8_t)(p->count >> 8)
+        };
+        sim.peerSend(at, header, sizeof(header));
+        sim.peerSend(at, (const uint8_t *)p->samples, p->count * sizeof(float));
+    }
+}
+
+static void gateway() {
+    static simPeer a, b;
+    static PeerLog log;
+    Gateway gw(BLE, log);
+
+    printf("Gateway\n");
+    for (int i = 0; i < 30; i++) {
+        addSample(a, 20.0 + i * 0.25);
+    }
+    for (int i = 0; i < 120; i++) {
+        addSample(b, -5.0 - i * 0.01);
+    }
+    a.asleep = true;
+    module.addRemote("001EC0AAAAAA", "DSMini_AAAA", peerHandler, &a);
+    module.addRemote("001EC0CCCCCC", "Phone", NULL, NULL);
+    module.addRemote("001EC0BBBBBB", "DSMini_BBBB", peerHandler, &b);
+
+    module.powerOn();
+    BLE.waitForBoot(1000);
+    uint64_t start = simNow();
+    int n = gw.collect(1000);
+    printf("  %-44s %llu ms\n", "first collection", (unsigned long long)(simNow() - start) / 1000);
+    check("all held samples collected", n == 30 + GATEWAY_MAX_SAMPLES);
+    check("only DSMinis contacted", log.find("001EC0CCCCCC") < 0);
+
+    int peer;
+    uint32_t seq;
+    float t;
+    check("records in order", log.get(0, peer, seq, t) && !strcmp(log.address(peer), "001EC0AAAAAA") && (seq == 1) && (t == 20.0));
+    check("oldest kept sample numbered", log.get(30, peer, seq, t) && (seq == 120 - GATEWAY_MAX_SAMPLES + 1));
+
+    a.asleep = true;
+    check("nothing new collected twice", gw.collect(1000) == 0);
+
+    addSample(a, 30.5);
+    addSample(b, -7.5);
+    addSample(b, -7.75);
+    n = gw.collect(1000);
+    check("only new samples collected", n == 3);
+    check("newest sample", log.get(log.size() - 1, peer, seq, t) && (peer == log.find("001EC0BBBBBB")) && (seq == 122) && (t == -7.75));
+
+    // As saved to EERAM and loaded back: the raw bytes only
+    static PeerLog copy;
+    copy.clear();
+    memcpy(copy.data(), log.data(), log.dataSize());
+    bool same = copy.validate() && (copy.size() == log.size());
+    for (int p = 0; same && (p < PEERLOG_PEERS); p++) {
+        const char *a = log.address(p);
+        const char *b = copy.address(p);
+        same = ((a == NULL) == (b == NULL)) && ((a == NULL) || !strcmp(a, b)) &&
+               (copy.lastSequence(p) == log.lastSequence(p));
+    }
+    for (size_t i = 0; same && (i < log.size()); i++) {
+        int p1, p2;
+        uint32_t s1, s2;
+        float t1, t2;
+        same = log.get(i, p1, s1, t1) && copy.get(i, p2, s2, t2) && (p1 == p2) && (s1 == s2) && (t1 == t2);
+    }
+    check("log survives a copy", same);
+}
+
+int main() {
+    bootConfiguration();
+    formatting();
+    commands();
+    throughput();
+    dormant();
+    gateway();
+    printf("%d failure%s\n", failures, failures == 1 ? "" : "s");
+    return failures ? 1 : 0;
+}
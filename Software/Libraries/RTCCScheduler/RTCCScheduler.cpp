@@ -0,0 +1,192 @@
+#include <RTCCScheduler.h>
+#include <errno.h>
+
+// Set when the alarm goes off, until run() has dealt with it
+static volatile bool fired = false;
+
+// Wakes the chip. run() works out what is due; the flag is only there so
+// an alarm that goes off while we are still awake is not slept through.
+static void alarm() {
+    fired = true;
+}
+
+RTCCScheduler::RTCCScheduler() : _now(0), _lastTod(0) {
+    for (int i = 0; i < SCHEDULER_TASKS; i++) {
+        _tasks[i].active = false;
+        _tasks[i].func = NULL;
+    }
+}
+
+uint32_t RTCCScheduler::timeOfDay() {
+    RTCCValue t = RTCC.value();
+    return (t.hours() * 60UL + t.minutes()) * 60UL + t.seconds();
+}
+
+/*! Take over the RTCC alarm. The RTCC must already be running. */
+void RTCCScheduler::begin() {
+    _lastTod = timeOfDay();
+    RTCC.alarmDisable();
+    RTCC.attachInterrupt(&alarm);
+}
+
+/*! Seconds since begin(). */
+uint32_t RTCCScheduler::now() {
+    uint32_t tod = timeOfDay();
+    _now += (tod + SCHEDULER_DAY - _lastTod) % SCHEDULER_DAY;
+    _lastTod = tod;
+    return _now;
+}
+
+int RTCCScheduler::allocate(void (*func)(), uint32_t period) {
+    for (int i = 0; i < SCHEDULER_TASKS; i++) {
+        if (_tasks[i].func == NULL) {
+            _tasks[i].func = func;
+            _tasks[i].period = period;
+            _tasks[i].active = false;
+            return i;
+        }
+    }
+    errno = ENOSPC;
+    return -1;
+}
+
+/*! Add a task that runs every period seconds, starting with the next
+ *  aligned time. Returns its id, or -1 with errno set to ENOSPC.
+ */
+int RTCCScheduler::every(void (*func)(), uint32_t period) {
+    if (period == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    int id = allocate(func, period);
+    if (id >= 0) {
+        now(); // Brings the time of day up to date
+        uint32_t delay = period;
+        if ((SCHEDULER_DAY % period) == 0) {
+            delay = period - (_lastTod % period);
+        }
+        start(id, delay);
+    }
+    return id;
+}
+
+/*! Add a one-shot task. It does nothing until start() arms it. */
+int RTCCScheduler::once(void (*func)()) {
+    return allocate(func, 0);
+}
+
+/*! Run a task delay seconds from now, replacing any earlier deadline.
+ *
+ *  A periodic task carries on at its period from there.
+ */
+void RTCCScheduler::start(int id, uint32_t delay) {
+    if ((id < 0) || (id >= SCHEDULER_TASKS) || (_tasks[id].func == NULL)) {
+        return;
+    }
+    _tasks[id].deadline = now() + delay;
+    _tasks[id].active = true;
+    setAlarm();
+}
+
+void RTCCScheduler::stop(int id) {
+    if ((id < 0) || (id >= SCHEDULER_TASKS)) {
+        return;
+    }
+    _tasks[id].active = false;
+    setAlarm();
+}
+
+bool RTCCScheduler::active(int id) {
+    if ((id < 0) || (id >= SCHEDULER_TASKS)) {
+        return false;
+    }
+    return _tasks[id].active;
+}
+
+/*! Run everything that is due and set the alarm for what is next.
+ *
+ *  Call after every wake, whatever woke us. Tasks that were missed more
+ *  than once (a long stretch awake, say) run once, not once per period.
+ *  Returns the number of tasks run.
+ */
+int RTCCScheduler::run() {
+    int ran = 0;
+    fired = false;
+    bool again = true;
+    while (again) {
+        again = false;
+        for (int i = 0; i < SCHEDULER_TASKS; i++) {
+            task &t = _tasks[i];
+            uint32_t n = now();
+            if (!t.active || ((int32_t)(t.deadline - n) > 0)) {
+                continue;
+            }
+            if (t.period) {
+                while ((int32_t)(t.deadline - n) <= 0) {
+                    t.deadline += t.period;
+                }
+            } else {
+                t.active = false;
+            }
+            t.func();
+            ran++;
+            // The task may have taken time or armed others
+            again = true;
+        }
+    }
+    setAlarm();
+    return ran;
+}
+
+/*! True if run() has work waiting: the alarm has gone off since it last
+ *  ran, or a deadline has been reached.
+ *
+ *  Check it with interrupts disabled just before sleeping. The alarm can
+ *  go off between run() and the sleep, and then nothing would wake us
+ *  until the next one. With interrupts disabled it stays pending and the
+ *  chip still wakes from the sleep, so either this sees it or the sleep
+ *  ends at once.
+ */
+bool RTCCScheduler::pending() {
+    if (fired) {
+        return true;
+    }
+    uint32_t n = now();
+    for (int i = 0; i < SCHEDULER_TASKS; i++) {
+        if (_tasks[i].active && ((int32_t)(_tasks[i].deadline - n) <= 0)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The alarm compares the time of day only, which is enough because a
+// periodic task always wakes us within a day.
+void RTCCScheduler::setAlarm() {
+    uint32_t n = now();
+    int next = -1;
+    for (int i = 0; i < SCHEDULER_TASKS; i++) {
+        if (_tasks[i].active && ((next < 0) || ((int32_t)(_tasks[i].deadline - _tasks[next].deadline) < 0))) {
+            next = i;
+        }
+    }
+
+    RTCC.alarmDisable();
+    if (next < 0) {
+        return;
+    }
+
+    // Never aim at the current second, which may already be over
+    uint32_t delay = _tasks[next].deadline - n;
+    if (((int32_t)delay < 1)) {
+        delay = 1;
+    }
+    uint32_t tod = (_lastTod + delay) % SCHEDULER_DAY;
+
+    RTCCValue a = RTCC.value();
+    a.time(tod / 3600, (tod / 60) % 60, tod % 60);
+    RTCC.alarmSet(a);
+    RTCC.alarmMask(AL_DAY);
+    RTCC.chimeDisable();
+    RTCC.alarmEnable();
+}
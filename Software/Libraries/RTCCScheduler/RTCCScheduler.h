@@ -0,0 +1,55 @@
+#ifndef _RTCCSCHEDULER_H
+#define _RTCCSCHEDULER_H
+
+#include <Arduino.h>
+#include <RTCC.h>
+
+#define SCHEDULER_TASKS 8
+#define SCHEDULER_DAY 86400UL
+
+/*
+ * Deadline scheduler running off the RTCC alarm.
+ *
+ * Tasks are either periodic or one-shot and count in whole seconds. The
+ * alarm is always set for the earliest deadline, so the chip sleeps until
+ * there is work to do, and every task that is due runs in the same wake.
+ *
+ * Periods that divide a day are aligned to the time of day, so an hourly
+ * task runs on the hour. Time is kept as seconds since begin() and stays
+ * monotonic across midnight and month ends as long as we wake at least
+ * once a day.
+ */
+class RTCCScheduler {
+    private:
+        typedef struct {
+            void (*func)();
+            uint32_t period;    // 0 for one-shot
+            uint32_t deadline;
+            bool active;
+        } task;
+
+        task _tasks[SCHEDULER_TASKS];
+        uint32_t _now;
+        uint32_t _lastTod;
+
+        static uint32_t timeOfDay();
+        void setAlarm();
+        int allocate(void (*func)(), uint32_t period);
+
+    public:
+        RTCCScheduler();
+
+        void begin();
+
+        int every(void (*func)(), uint32_t period);
+        int once(void (*func)());
+        void start(int id, uint32_t delay);
+        void stop(int id);
+        bool active(int id);
+
+        int run();
+        bool pending();
+        uint32_t now();
+};
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef _RINGBUFFER_H
+#define _RINGBUFFER_H
+
+#include <stddef.h>
+
+/*
+ * Fixed capacity ring of N items of type T.
+ *
+ * push() is O(1) whatever the capacity, and drops the oldest item once the
+ * ring is full. Items are indexed in logical order, 0 being the oldest
+ * still held. N does not need to be a power of two.
+ *
+ * The storage is a plain array, so it can be saved and loaded directly.
+ * index() gives the slot a logical item lives in, which lets a single new
+ * item be saved on its own, and restore() puts the ring back together
+ * after the array has been loaded.
+ */
+template <typename T, size_t N>
+class RingBuffer {
+    private:
+        T _data[N];
+        size_t _head;   // Slot the next item goes in
+        size_t _count;
+
+    public:
+        RingBuffer() : _head(0), _count(0) {}
+
+        void clear() { _head = 0; _count = 0; }
+        size_t size() const { return _count; }
+        size_t capacity() const { return N; }
+        bool empty() const { return _count == 0; }
+        bool full() const { return _count == N; }
+
+        void push(const T &v) {
+            _data[_head] = v;
+            if (++_head == N) {
+                _head = 0;
+            }
+            if (_count < N) {
+                _count++;
+            }
+        }
+
+        // Forget the n oldest items, for use as a queue
+        void drop(size_t n) {
+            _count = n < _count ? _count - n : 0;
+        }
+
+        // Slot holding logical item i
+        size_t index(size_t i) const {
+            size_t slot = _head + (N - _count) + i;
+            return slot >= N ? slot - N : slot;
+        }
+
+        T &operator[](size_t i) { return _data[index(i)]; }
+        const T &operator[](size_t i) const { return _data[index(i)]; }
+        T &oldest() { return _data[index(0)]; }
+        T &newest() { return _data[index(_count - 1)]; }
+
+        /*! Contiguous run of items starting at logical item i.
+         *
+         *  Sets p to the first and returns how many follow it in storage,
+         *  so the whole ring can be handed out in at most two blocks.
+         */
+        size_t span(size_t i, T *&p) {
+            if (i >= _count) {
+                p = NULL;
+                return 0;
+            }
+            size_t slot = index(i);
+            size_t run = N - slot;
+            p = &_data[slot];
+            return (_count - i) < run ? (_count - i) : run;
+        }
+
+        T *data() { return _data; }
+        size_t dataSize() const { return sizeof(_data); }
+
+        // Rebuild the ring around storage that has been loaded into data()
+        void restore(size_t head, size_t count) {
+            _head = head < N ? head : 0;
+            _count = count < N ? count : N;
+        }
+};
+
+#endif
@@ -0,0 +1,193 @@
+#include <SPIBus.h>
+#include <errno.h>
+
+#define SPISTAT_SPIRBF  0x00000001
+#define SPISTAT_SPITBE  0x00000008
+#define SPISTAT_SPIRBE  0x00000020
+#define SPISTAT_SPIROV  0x00000040
+#define SPISTAT_SPIBUSY 0x00000800
+#define SPICON_ENHBUF   0x00010000
+
+void SPIBus::begin() {
+    _spi->begin();
+    _configured = -1;
+}
+
+/*! Add a device to the bus. Its chip select is made an output and
+ *  released straight away, so it keeps off the bus until it is spoken to.
+ *
+ *  Returns the device number for its transactions, or -1 if there is no
+ *  room for another.
+ */
+int SPIBus::addDevice(uint8_t cs, uint16_t mode, uint32_t speed, int8_t dc) {
+    if (_count >= SPIBUS_DEVICES) {
+        errno = ENOSPC;
+        return -1;
+    }
+    _devices[_count].cs = cs;
+    _devices[_count].dc = dc;
+    _devices[_count].mode = mode;
+    _devices[_count].speed = speed;
+    pinMode(cs, OUTPUT);
+    digitalWrite(cs, HIGH);
+    if (dc >= 0) {
+        pinMode(dc, OUTPUT);
+    }
+    return _count++;
+}
+
+/*! Put a transaction at the back of the queue. It is started by the next
+ *  poll().
+ */
+bool SPIBus::queue(Transaction &t) {
+    if ((t.device < 0) || (t.device >= _count)) {
+        errno = ENODEV;
+        return false;
+    }
+    if (_queued >= SPIBUS_QUEUE) {
+        errno = ENOSPC;
+        return false;
+    }
+    t.done = false;
+    _queue[_tail] = &t;
+    _tail = (_tail + 1) % SPIBUS_QUEUE;
+    _queued++;
+    return true;
+}
+
+/*! Queue a transaction and wait for it, and anything queued before it,
+ *  to finish.
+ */
+void SPIBus::transfer(Transaction &t) {
+    while (!queue(t)) {
+        poll();
+    }
+    wait(t);
+}
+
+void SPIBus::wait(Transaction &t) {
+    while (!t.done) {
+        poll();
+    }
+}
+
+void SPIBus::waitIdle() {
+    while (!poll());
+}
+
+void SPIBus::select(int8_t dev) {
+    if (_selected == dev) {
+        return;
+    }
+    deselect();
+    if (_configured != dev) {
+        _spi->setMode(_devices[dev].mode);
+        _spi->setSpeed(_devices[dev].speed);
+        _configured = dev;
+    }
+    digitalWrite(_devices[dev].cs, LOW);
+    _selected = dev;
+}
+
+void SPIBus::deselect() {
+    if (_selected >= 0) {
+        digitalWrite(_devices[_selected].cs, HIGH);
+        _selected = -1;
+    }
+}
+
+void SPIBus::run(Transaction *t) {
+    select(t->device);
+    if (_devices[t->device].dc >= 0) {
+        digitalWrite(_devices[t->device].dc, t->command ? LOW : HIGH);
+    }
+    _current = t;
+#if defined(__PIC32MX__)
+    if ((_dma != NULL) && (t->tx != NULL) && (t->rx == NULL) && (t->len >= SPIBUS_DMA_MIN)) {
+        if (_dma->transfer(t->tx, t->len, &_spiRegs->buf.reg, _txirq)) {
+            _sending = true;
+            return;
+        }
+    }
+#endif
+    for (size_t i = 0; i < t->len; i++) {
+        uint8_t in = _spi->transfer((uint8_t)((t->tx == NULL) ? 0 : t->tx[i]));
+        if (t->rx != NULL) {
+            t->rx[i] = in;
+        }
+    }
+}
+
+/*! Move the queue along: finish the transaction under way if it is done
+ *  and start the ones after it. Transfers that don't go by DMA are run
+ *  there and then. The chip select is only released when the next
+ *  transaction is for another device or the queue runs dry.
+ *
+ *  Returns true once the queue is empty and the bus is free.
+ */
+bool SPIBus::poll() {
+    while (true) {
+        if (_current != NULL) {
+#if defined(__PIC32MX__)
+            if (_sending && !sendComplete()) {
+                return false;
+            }
+#endif
+            _current->done = true;
+            _current = NULL;
+        }
+        if (_queued == 0) {
+            deselect();
+            return true;
+        }
+        Transaction *t = _queue[_head];
+        _head = (_head + 1) % SPIBUS_QUEUE;
+        _queued--;
+        run(t);
+    }
+}
+
+#if defined(__PIC32MX__)
+/*! Send long transmit-only transfers through a DMA channel.
+ *
+ *  spicon is the first register of the SPI port behind the DSPI object
+ *  (SPI2CON for DSPI0 on the DSMini) and txirq its transmit interrupt
+ *  request (_SPI2_TX_IRQ), which paces the channel one byte at a time.
+ */
+bool SPIBus::attachDMA(DMAChannel &dma, volatile uint32_t *spicon, uint8_t txirq) {
+    if (!dma.begin()) {
+        errno = EBUSY;
+        return false;
+    }
+    _dma = &dma;
+    _spiRegs = (spiRegs *)spicon;
+    _txirq = txirq;
+    return true;
+}
+
+void SPIBus::detachDMA() {
+    if (_dma != NULL) {
+        waitIdle();
+        _dma->end();
+        _dma = NULL;
+    }
+}
+
+/*! The channel only fills the transmit buffer. Once it is done this waits
+ *  for the last byte to leave, throws away everything received meanwhile
+ *  and clears the overflow, so the next transfer reads its own data.
+ */
+bool SPIBus::sendComplete() {
+    if (_dma->busy()) {
+        return false;
+    }
+    while (!(_spiRegs->stat.reg & SPISTAT_SPITBE) || (_spiRegs->stat.reg & SPISTAT_SPIBUSY));
+    while ((_spiRegs->stat.reg & SPISTAT_SPIRBF) ||
+           ((_spiRegs->con.reg & SPICON_ENHBUF) && !(_spiRegs->stat.reg & SPISTAT_SPIRBE))) {
+        (void)_spiRegs->buf.reg;
+    }
+    _spiRegs->stat.clr = SPISTAT_SPIROV;
+    _sending = false;
+    return true;
+}
+#endif
@@ -0,0 +1,108 @@
+#ifndef _SPIBUS_H
+#define _SPIBUS_H
+
+#include <Arduino.h>
+#include <DSPI.h>
+#if defined(__PIC32MX__)
+#include <DMAChannel.h>
+#endif
+
+#define SPIBUS_DEVICES 4
+#define SPIBUS_QUEUE 8
+
+// Transmit-only transfers at least this long go by DMA when a channel is
+// attached. Shorter ones cost less to send by hand.
+#define SPIBUS_DMA_MIN 16
+
+/*
+ * Shares one SPI port between several devices, each with its own chip
+ * select, optional data/command line, mode and clock.
+ *
+ * Transactions are queued and run in order by poll(). A transaction
+ * belongs to the caller and is queued by reference, so it and its
+ * buffers must stay put until its done flag is set. Transactions for
+ * the same device that follow each other in the queue run back to back
+ * without the chip select being released or the port set up again.
+ *
+ * Nothing else may use the port while the bus is busy. Anything that
+ * does (a display driver's own initialisation, say) should be run after
+ * waitIdle(), followed by reconfigure().
+ */
+class SPIBus {
+    public:
+        typedef struct {
+            int8_t device;
+            bool command;       // Sent with the data/command line low
+            const uint8_t *tx;  // NULL to send zeros
+            uint8_t *rx;        // NULL to throw away what comes back
+            size_t len;
+            volatile bool done;
+        } Transaction;
+
+    private:
+        typedef struct {
+            uint8_t cs;
+            int8_t dc;
+            uint16_t mode;
+            uint32_t speed;
+        } device;
+
+        DSPI *_spi;
+        device _devices[SPIBUS_DEVICES];
+        uint8_t _count;
+        Transaction *_queue[SPIBUS_QUEUE];
+        uint8_t _head;
+        uint8_t _tail;
+        uint8_t _queued;
+        Transaction *_current;
+        int8_t _selected;
+        int8_t _configured;
+
+#if defined(__PIC32MX__)
+        typedef struct {
+            volatile uint32_t reg;
+            volatile uint32_t clr;
+            volatile uint32_t set;
+            volatile uint32_t inv;
+        } spiReg;
+
+        typedef struct {
+            spiReg con;
+            spiReg stat;
+            spiReg buf;
+        } spiRegs;
+
+        DMAChannel *_dma;
+        spiRegs *_spiRegs;
+        uint8_t _txirq;
+        bool _sending;
+
+        bool sendComplete();
+#endif
+
+        void select(int8_t dev);
+        void deselect();
+        void run(Transaction *t);
+
+    public:
+#if defined(__PIC32MX__)
+        SPIBus(DSPI &spi) : _spi(&spi), _count(0), _head(0), _tail(0), _queued(0), _current(NULL), _selected(-1), _configured(-1), _dma(NULL), _sending(false) {}
+
+        bool attachDMA(DMAChannel &dma, volatile uint32_t *spicon, uint8_t txirq);
+        void detachDMA();
+#else
+        SPIBus(DSPI &spi) : _spi(&spi), _count(0), _head(0), _tail(0), _queued(0), _current(NULL), _selected(-1), _configured(-1) {}
+#endif
+
+        void begin();
+        int addDevice(uint8_t cs, uint16_t mode, uint32_t speed, int8_t dc = -1);
+
+        bool queue(Transaction &t);
+        void transfer(Transaction &t);
+        bool poll();
+        void wait(Transaction &t);
+        void waitIdle();
+        void reconfigure() { _configured = -1; }
+};
+
+#endif
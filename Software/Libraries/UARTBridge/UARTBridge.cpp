@@ -0,0 +1,166 @@
+#include <UARTBridge.h>
+#include <errno.h>
+
+/*! Start relaying.
+ *
+ *  rxreg and rxirq are the click UART's receive register and interrupt
+ *  request (U1RXREG and _UART1_RX_IRQ for Serial on the DSMini), txreg
+ *  and txirq its transmit ones. The UART must already have been started
+ *  with begin() at the click's baud rate. Its driver no longer sees what
+ *  arrives until end().
+ *
+ *  Returns false with errno set to EBUSY if a DMA channel is taken.
+ */
+bool UARTBridge::begin(volatile void *rxreg, uint8_t rxirq, volatile void *txreg, uint8_t txirq, int rts, int cts) {
+    if (!_rxDMA->begin()) {
+        errno = EBUSY;
+        return false;
+    }
+    if (!_txDMA->begin()) {
+        _rxDMA->end();
+        errno = EBUSY;
+        return false;
+    }
+    _txreg = txreg;
+    _rxirq = rxirq;
+    _txirq = txirq;
+    _rts = rts;
+    _cts = cts;
+
+    if (_rts >= 0) {
+        pinMode(_rts, OUTPUT);
+        digitalWrite(_rts, LOW);
+    }
+    if (_cts >= 0) {
+        pinMode(_cts, INPUT);
+    }
+
+    _upTaken = 0;
+    _upSending = 0;
+    _upWaiting = false;
+    _overruns = 0;
+    _down.clear();
+    _downSending = 0;
+
+    // Otherwise the serial driver takes each byte before the channel can
+    clearIntEnable(_rxirq);
+    _rxDMA->receiveContinuous(rxreg, 1, _up, BRIDGE_RING, _rxirq);
+    return true;
+}
+
+void UARTBridge::end() {
+    _rxDMA->abort();
+    _rxDMA->end();
+    while (_txDMA->busy());
+    _txDMA->end();
+    _ble->flush();
+    setIntEnable(_rxirq);
+    if (_rts >= 0) {
+        digitalWrite(_rts, LOW);
+    }
+}
+
+// Bytes the channel has written since begin(). The position alone cannot
+// tell a full ring from an empty one, so the halves filled count the laps.
+uint32_t UARTBridge::upWritten() {
+    uint32_t halves;
+    size_t pos;
+    do {
+        halves = _rxDMA->halves();
+        pos = _rxDMA->position();
+    } while (halves != _rxDMA->halves());
+
+    // The channel may have crossed into the next half with its interrupt
+    // still to come
+    const size_t half = BRIDGE_RING / 2;
+    if ((pos / half) != (halves & 1)) {
+        halves++;
+    }
+    return halves * half + pos % half;
+}
+
+// Bytes from the click not yet sent on, counting any being sent now
+uint32_t UARTBridge::upWaiting() {
+    return upWritten() - _upTaken;
+}
+
+void UARTBridge::pollUp() {
+    if ((_upSending > 0) && _ble->writeComplete()) {
+        _upTaken += _upSending;
+        _upSending = 0;
+    }
+
+    uint32_t n = upWaiting();
+    if ((_upSending == 0) && (n > BRIDGE_RING)) {
+        // The click has lapped us and what it overwrote is gone. Carry on
+        // from the oldest byte still in the ring.
+        _overruns += n - BRIDGE_RING;
+        _upTaken += n - BRIDGE_RING;
+        n = BRIDGE_RING;
+    }
+    if (_rts >= 0) {
+        if (n >= BRIDGE_RING * 3 / 4) {
+            digitalWrite(_rts, HIGH);
+        } else if (n <= BRIDGE_RING / 4) {
+            digitalWrite(_rts, LOW);
+        }
+    }
+
+    if (_upSending > 0) {
+        return;
+    }
+    if (n == 0) {
+        _upWaiting = false;
+        return;
+    }
+    if (!_upWaiting) {
+        _upWaiting = true;
+        _upSince = millis();
+    }
+    if ((n < BRIDGE_BLOCK) && (millis() - _upSince < BRIDGE_LATENCY)) {
+        return;
+    }
+
+    // Up to the end of the ring; the rest goes next time
+    size_t tail = _upTaken % BRIDGE_RING;
+    size_t run = BRIDGE_RING - tail;
+    if (n < run) {
+        run = n;
+    }
+    _upSending = _ble->writeAsync(_up + tail, run);
+    _upWaiting = false;
+}
+
+void UARTBridge::pollDown() {
+    if ((_downSending > 0) && !_txDMA->busy()) {
+        _down.drop(_downSending);
+        _downSending = 0;
+    }
+
+    while (!_down.full() && (_ble->available() > 0)) {
+        _down.push(_ble->read());
+    }
+
+    if ((_downSending > 0) || _down.empty()) {
+        return;
+    }
+    if ((_cts >= 0) && (digitalRead(_cts) == HIGH)) {
+        return;
+    }
+    uint8_t *p;
+    size_t run = _down.span(0, p);
+    if (_txDMA->transfer(p, run, _txreg, _txirq)) {
+        _downSending = run;
+    }
+}
+
+/*! Move whatever is ready in both directions.
+ *
+ *  Returns true while data is still waiting or on its way, false once
+ *  both directions are idle.
+ */
+bool UARTBridge::poll() {
+    pollUp();
+    pollDown();
+    return (_upSending > 0) || (upWaiting() > 0) || (_downSending > 0) || !_down.empty();
+}
@@ -0,0 +1,75 @@
+#ifndef _UARTBRIDGE_H
+#define _UARTBRIDGE_H
+
+#include <Arduino.h>
+#include <DMAChannel.h>
+#include <RingBuffer.h>
+#include <RN4871.h>
+
+// Bytes buffered in each direction
+#define BRIDGE_RING 512
+
+// Data from the click is passed on once this much has built up, or once
+// the oldest byte has waited BRIDGE_LATENCY ms.
+#define BRIDGE_BLOCK 64
+#define BRIDGE_LATENCY 5
+
+/*
+ * Relays a click board's UART over the RN4871's Transparent UART.
+ *
+ * Upstream, a DMA channel writes everything the click sends into a ring
+ * and the RN4871 is handed runs of that same ring to send, so the data
+ * is never copied. Downstream, bytes from the link are queued in a
+ * second ring and sent to the click by another DMA channel.
+ *
+ * Nothing is done per byte, so between polls the CPU can sit in Idle:
+ * the UARTs need the peripheral clock, so not Sleep. The DMA interrupts,
+ * the serial driver and the core timer tick all wake it.
+ *
+ * Flow control is optional. rts is driven high to hold the click off
+ * while the upstream ring is three quarters full, and the click holding
+ * cts high pauses downstream sends. The link itself has no flow control,
+ * so downstream data waits in the serial driver while the ring is full.
+ * Without flow control a click that gets a whole ring ahead overwrites
+ * data not sent yet, and overruns() counts the bytes lost.
+ */
+class UARTBridge {
+    private:
+        RN4871 *_ble;
+        DMAChannel *_rxDMA;
+        DMAChannel *_txDMA;
+        volatile void *_txreg;
+        uint8_t _rxirq;
+        uint8_t _txirq;
+        int _rts;
+        int _cts;
+
+        uint8_t _up[BRIDGE_RING];   // Filled by _rxDMA, round and round
+        uint32_t _upTaken;          // Bytes sent on (or being sent) since begin()
+        size_t _upSending;          // Bytes the link is sending now
+        uint32_t _upSince;          // When data was first seen waiting
+        bool _upWaiting;
+
+        uint32_t _overruns;
+
+        RingBuffer<uint8_t, BRIDGE_RING> _down;
+        size_t _downSending;
+
+        uint32_t upWritten();
+        uint32_t upWaiting();
+        void pollUp();
+        void pollDown();
+
+    public:
+        UARTBridge(RN4871 &ble, DMAChannel &rx, DMAChannel &tx) :
+            _ble(&ble), _rxDMA(&rx), _txDMA(&tx), _rts(-1), _cts(-1),
+            _upTaken(0), _upSending(0), _upSince(0), _upWaiting(false), _overruns(0), _downSending(0) {}
+
+        bool begin(volatile void *rxreg, uint8_t rxirq, volatile void *txreg, uint8_t txirq, int rts = -1, int cts = -1);
+        void end();
+
+        bool poll();
+        uint32_t overruns() { return _overruns; }
+};
+
+#endif
@@ -1,17 +1,27 @@
 #include <RN4871.h>
+#include <DMAChannel.h>
+#include <RingBuffer.h>
+#include <UARTBridge.h>
+#include <LowPower.h>
 
 RN4871 BLE(Serial1);
+DMAChannel bleDMA(0);
+DMAChannel clickRX(2);
+DMAChannel clickTX(3);
+
+// Relays the click UART (Serial) over the link
+UARTBridge bridge(BLE, clickRX, clickTX);
 
 void setup() {
     Serial.begin(115200);
     pinMode(PIN_BLUETOOTH_POWER, OUTPUT);
     digitalWrite(PIN_BLUETOOTH_POWER, HIGH);
-    delay(1000);
     Serial1.begin(115200);
+    BLE.waitForBoot(1000);
     BLE.begin();
     BLE.enterCommandMode();
     BLE.factoryReset();
-    delay(1000);
+    BLE.waitForBoot(1000);
     BLE.enterCommandMode();
     BLE.setDeviceName("DSMini0005");
     BLE.setFeatures(RN4871::Feature::NoPrompt);
@@ -24,14 +34,16 @@ void setup() {
     BLE.setDISManufacturer("Majenko Technologies");
     BLE.setDISSerialNumber("1");
     BLE.reboot();
-    BLE.enterDataMode();
+    // The module comes back from %REBOOT% in data mode, so there is no
+    // command mode to leave.
+    BLE.waitForBoot(1000);
+    BLE.attachDMA(bleDMA, &U2TXREG, _UART2_TX_IRQ);
+    bridge.begin(&U1RXREG, _UART1_RX_IRQ, &U1TXREG, _UART1_TX_IRQ);
 }
 
+// The UARTs need the peripheral clock, so Idle rather than Sleep. Any
+// interrupt brings us back to pass on what has arrived.
 void loop() {
-    while (Serial1.available()) {
-        Serial.write(Serial1.read());
-    }
-    while (Serial.available()) {
-        Serial1.write(Serial.read());
-    }
+    bridge.poll();
+    LowPower.enterIdleMode();
 }
@@ -1,185 +1,467 @@
 /*
  * Samples the temperature every hour and sleeps in between using as little power as
- * possible. Wakes on a button press to display the data, and wakes 10 seconds later
+ * possible. Wakes on a button press to display the data, and wakes a few seconds later
  * again to disable the screen.
  */
 
 #include <DisplayCore.h>
 #include <DSPI.h>
 #include <SSD1306.h>
+#include <DTWIProbe.h>
 #include <EMC1001_DTWI.h>
 #include <RTCC.h>
 #include <LowPower.h>
 #include <EERAM_DTWI.h>
+#include <DMAChannel.h>
 #include <RN4871.h>
+#include <Gateway.h>
+#include <RingBuffer.h>
+#include <RTCCScheduler.h>
+#include <PowerRails.h>
+#include <PowerProfiles.h>
+#include <EventQueue.h>
+#include <Coroutine.h>
+#include <SPIBus.h>
+#include <OLEDFrame.h>
+#include <Format.h>
 
 RN4871 BLE(Serial1);
-
-// Default pin modes when saving power
-const uint8_t defmodes[NUM_DIGITAL_PINS] = {
-	INPUT_PULLDOWN,
-	INPUT_PULLDOWN,
-	INPUT_PULLDOWN,
-	INPUT_PULLDOWN,
-	INPUT_PULLDOWN,
-	INPUT_PULLDOWN,
-	INPUT_PULLDOWN,
-	INPUT_PULLDOWN,
-	INPUT_PULLDOWN,
-	INPUT_PULLDOWN,
-	INPUT_PULLDOWN,
-	INPUT_PULLDOWN,
-	INPUT_PULLUP, // User button
-	INPUT_PULLDOWN,
-	INPUT_PULLDOWN,
-	INPUT_PULLDOWN,
-	INPUT, // RX
-	INPUT, // TX
-	INPUT_PULLDOWN,
-	INPUT_PULLDOWN,
-};
-
-#define SAMPLE  0x01
-#define BUTTON  0x02
-#define SNOOZE  0x04
-#define SLEEP   0x08
-#define SERIAL  0x10
+DMAChannel bleDMA(0);
+
+// Event sources, one per interrupt handler
+#define BUTTON  0
+#define SERIAL  1
+
+// Seconds between samples. Periods that divide a day run on the clock,
+// so the default samples on the hour.
+#define SAMPLE_PERIOD 3600
+
+// How long the display stays on after a press, and how long the radio
+// stays on after a second press, in seconds.
+#define DISPLAY_TIME 5
+#define RADIO_TIME 20
+
+// Uncomment to switch the radio on for a while every period so that a
+// gateway can reach us. Periods that match the gateway's line the two up.
+// #define ADVERTISE_PERIOD 3600
+#define ADVERTISE_TIME 60
+
+RTCCScheduler scheduler;
+int windowTask; // Ends the display or radio window
+
+// The sensor rail feeds the sensor, the EERAM and the display, the radio
+// rail the RN4871. The sensor rail is kept up for a little while after
+// use, so a sample and a press close together share one power up.
+PowerRails rails;
+int sensorRail;
+int radioRail;
+#define SENSOR_SETTLE 5 // ms
+#define SENSOR_HOLD 2   // s
+#define RADIO_SETTLE 10 // ms
+
+// Peripherals switched on by what we are doing. The RTCC wakes us and
+// Timer5 stays as before. I2C2 is always on, so sampling needs no profile
+// of its own: switching its power and clock off, even when not in use
+// yet, seems to kill it.
+const PowerProfile sleepProfile = POWER_PROFILE(PMD_RTCC | PMD_T5 | PMD_I2C2);
+const PowerProfile displayProfile = POWER_PROFILE(PMD_SPI2);
+const PowerProfile radioProfile = POWER_PROFILE(PMD_UART2);
+
+PowerProfiles power;
+int displayPeripherals;
+int radioPeripherals;
+
+// Taking a sample runs over several passes of the loop, so events are
+// still handled while the sensor converts and the result is saved.
+Coroutine sampling;
 
 #define NUM_TEMPS 96
 
-float temperature[NUM_TEMPS] = {0};
-volatile uint32_t wakeReason = 0;
-
+RingBuffer<float, NUM_TEMPS> temperature;
+// Samples ever taken. A gateway uses it to tell which are new, and it
+// places the newest sample in the ring when the history is loaded.
+uint32_t sampleCount = 0;
+EventQueue events;
+
+// Contact bounce goes on posting presses for this many ms after the
+// first. millis() stops in Sleep, so we stay awake until it is over.
+#define BUTTON_DEBOUNCE 50
+
+bool debouncing = false;
+uint32_t lastPress = 0; // millis() of the last button press acted on
+
+// Radio state. While connected we sleep and let the RX line wake us.
+bool rfEnabled = false;
+bool rfConnected = false;
+volatile bool rfWakePending = false; // RX woke us and RF_READY is not sent yet
+
+// Pin wired to the RN4871 UART_RX_IND line, if the board has one. Without
+// it the module cannot be woken from dormant and is always powered off.
+// #define PIN_RF_WAKE 13
+
+// If radio sessions are usually closer together than this many seconds
+// the module is left dormant between them instead of being powered off.
+#define RF_WARM_WINDOW 900
+
+bool rfDormant = false;
+uint32_t rfLastStart = 0;
+uint32_t rfGap = 0xFFFFFFFF; // Smoothed time between sessions, in seconds
+
+// Sent to the peer once we are back on the fast clock after an RX wake.
+// The byte that woke us (and anything else arriving during the clock
+// switch) cannot be received, so the peer holds its data until it sees this.
+#define RF_READY GATEWAY_READY
+
+// Build as a gateway that collects the readings of the other DSMinis in
+// range every hour. Scanning and connecting keeps the radio on for several
+// seconds each time, so this is for a unit on mains power. The others are
+// only found while their radio is on.
+// #define GATEWAY_MODE
+#define GATEWAY_SCAN_TIME 5000
+
+// The peer log lives in EERAM after our own history
+#define PEERLOG_ADDRESS 512
+
+// Kept just below the peer log once the EERAM has been set up. Anything
+// else there means the chip is blank or laid out by another build, and
+// the saved data is cleared rather than trusted. Bump the low half when
+// the layout changes.
+#define EERAM_MAGIC_ADDRESS 508
+#define EERAM_MAGIC 0x44530001
+
+// Collected readings not saved yet. The save waits for the sample taken
+// in the same wake, which has the I2C bus.
+bool peerLogDirty = false;
+
+#if defined(GATEWAY_MODE)
+PeerLog peerLog;
+Gateway gateway(BLE, peerLog);
+#endif
+
+// Everything on the click SPI port goes through the bus, which sends
+// long writes such as the screen by DMA.
 DSPI0 spi;
+SPIBus spiBus(spi);
+DMAChannel spiDMA(1);
 CLICK_OLED_B oled(spi, PIN_C1_CS, PIN_C1_PWM, PIN_C1_RST);
 
+// The screen is the readout line, a fixed grid and the plot, which moves
+// one column left per sample. It is composed as samples come in, so a
+// press only has to add the readout and send it.
+OLEDFrame screen(spiBus, PIN_C1_CS, PIN_C1_PWM);
+OLEDLayer readout, plot;
+OLEDLayer * const layers[] = { &readout, &plot };
+
+// The grid repeats every eight columns: a tick at rows 31, 21, 16 and 11
+// on the first, and the zero line at row 26 dotted on every other column.
+const OLEDPattern grid = {
+	{ 0x00000000, 0x00000000 },
+	{ 0x00000008, 0x00000000 },
+	{ 0x00000021, 0x00000000 },
+	{ 0x00040084, 0x00040004 },
+	{ 0x00000000, 0x00000000 },
+};
+
+// The panel hangs off the sensor rail. If presses usually come closer
+// together than this many seconds the rail is held up between them with
+// the panel asleep, so the next press only has to wake it.
+#define DISPLAY_WARM_WINDOW 300
+
+bool displayLit = false;
+uint16_t displayPower = 0; // Sensor rail power up the panel was set up in
+uint32_t displayLastOn = 0;
+uint32_t displayGap = 0xFFFFFFFF; // Smoothed time between presses, in seconds
+
 DTWI0 dtwi;
 EMC1001 emc(dtwi);;
 EERAM eeram(dtwi);
 
+// Define after changing the pin tables in the board variant. The hand
+// worked pinProfileSleep and FastPin are checked against them at start
+// up, and if either is out the LED is lit and we go no further.
+// #define CHECK_PIN_TABLES
+
 void setup() {
-	pinMode(PIN_SENSOR_POWER, OUTPUT);
-	digitalWrite(PIN_SENSOR_POWER, HIGH);
-// Disabling I2C's power and clock, even when not in use yet, seems to kill it.
-// So we need to disable things manually so as to keep I2C working.
-// LowPower.disableAllPeripherals();
-	LowPower.disableADC();
-	LowPower.disableCTMU();
-	LowPower.disableComparatorVoltageReference();
-	LowPower.disableComparator1();
-	LowPower.disableComparator2();
-	LowPower.disableComparator3();
-	LowPower.disableInputCapture1();
-	LowPower.disableInputCapture2();
-	LowPower.disableInputCapture3();
-	LowPower.disableInputCapture4();
-	LowPower.disableInputCapture5();
-	LowPower.disableOutputCompare1();
-	LowPower.disableOutputCompare2();
-	LowPower.disableOutputCompare3();
-	LowPower.disableOutputCompare4();
-	LowPower.disableOutputCompare5();
-	LowPower.disableTimer1();
-	LowPower.disableTimer2();
-	LowPower.disableTimer3();
-	LowPower.enableTimer4();
-	LowPower.enableTimer5();
-	LowPower.disableUART1();
-	LowPower.disableUART2();
-	LowPower.disableSPI1();
-	LowPower.enableSPI2();
-	LowPower.disableI2C1();
-	LowPower.enableI2C2();
-	LowPower.disableUSB();
-	LowPower.enableRTCC();
+#if defined(CHECK_PIN_TABLES)
+	if ((checkPinProfile(&pinProfileSleep) >= 0) || (checkFastPins() >= 0)) {
+		pinMode(PIN_LED1, OUTPUT);
+		digitalWrite(PIN_LED1, HIGH);
+		while (1);
+	}
+#endif
+	power.begin(sleepProfile);
+	displayPeripherals = power.add(displayProfile);
+	radioPeripherals = power.add(radioProfile);
 	initRTC();
-	attachInterrupt(1, displayData, FALLING);
+	scheduler.begin();
+	windowTask = scheduler.once(windowEnd);
+	rails.begin(scheduler, scheduler.once(railsExpire));
+	sensorRail = rails.add<PIN_SENSOR_POWER>(SENSOR_SETTLE, SENSOR_HOLD, resetPins);
+	radioRail = rails.add<PIN_BLUETOOTH_POWER>(RADIO_SETTLE, 0, radioOff);
+	scheduler.every(sampleTask, SAMPLE_PERIOD);
+#if defined(GATEWAY_MODE)
+	scheduler.every(collectTask, SAMPLE_PERIOD);
+#elif defined(ADVERTISE_PERIOD)
+	scheduler.every(advertiseTask, ADVERTISE_PERIOD);
+#endif
+	spiBus.attachDMA(spiDMA, &SPI2CON, _SPI2_TX_IRQ);
 	pinMode(12, INPUT_PULLUP);
+	attachWakeSource(12, WAKE_FALLING, displayData);
+	rails.acquire(sensorRail);
+	rails.wait(sensorRail);
 	loadEERAMData();
-	disableSensorPower();
+	rails.release(sensorRail, 0);
+	drawPlot();
+	screen.compose(layers, 2, &grid);
+#if defined(PIN_RF_WAKE)
+	BLE.setWakePin(PIN_RF_WAKE);
+#endif
 //	initRF();
 }
 
 void loop() {
-	static uint8_t sleepMethod = SLEEP;
-	disableMemsOsc();
-	wakeReason = 0;
-
-	if (sleepMethod == SLEEP) {
-		LowPower.enterSleepMode();
-	} else if (sleepMethod == SNOOZE) {
-		LowPower.enterIdleMode();
+	// Anything posted since the last drain would otherwise wait for the
+	// next wake, and a sample in progress needs the loop to keep going.
+	if (debouncing && (millis() - lastPress >= BUTTON_DEBOUNCE)) {
+		debouncing = false;
+	}
+	if (events.empty() && !sampling.running() && !peerLogDirty) {
+		if (debouncing || !spiBus.poll()) {
+			// Sleep would stop the SPI clock under the transfer being sent,
+			// and millis() under the debounce. Idle keeps both going, and the
+			// end of the transfer or the next tick wakes us.
+			LowPower.enterIdleMode();
+		} else {
+			disableMemsOsc();
+
+			// The RTCC alarm keeps running in Sleep, so we always sleep deeply,
+			// even with the display on.
+			if (rfConnected) {
+				enableRXWake();
+			}
+			// Anything that came in since the check above, the RTCC alarm
+			// above all, would otherwise be slept through. Held off like
+			// this it still ends the sleep, and its handler runs after.
+			uint32_t status = disableInterrupts();
+			if (events.empty() && !scheduler.pending()) {
+				LowPower.enterSleepMode();
+			}
+			restoreInterrupts(status);
+			disableRXWake();
+
+			enableMemsOsc();
+			if (rfWakePending) {
+				// Only what arrived while the clock was switching is garbage:
+				// let a byte in flight finish, then drop what is buffered.
+				// Anything after this is real and is left for handleRF().
+				delayMicroseconds(100);
+				while (Serial1.available()) {
+					(void)Serial1.read();
+				}
+			}
+		}
+	}
+
+	EventQueue::Event e;
+	while (events.get(e)) {
+		switch (e.source) {
+			case SERIAL:
+				rfWoken();
+				break;
+			case BUTTON:
+				if (!debouncing || (e.ms - lastPress >= BUTTON_DEBOUNCE)) {
+					lastPress = e.ms;
+					debouncing = true;
+					buttonPressed();
+				}
+				break;
+		}
+	}
+
+	if (rfEnabled && Serial1.available()) {
+		handleRF();
+	}
+
+	if (sampling.running() && sampleStep()) {
+		rails.release(sensorRail);
+	}
+
+#if defined(GATEWAY_MODE)
+	if (peerLogDirty && !sampling.running()) {
+		peerLogDirty = false;
+		savePeerLog();
+	}
+#endif
+
+	// Whatever woke us, run anything that is due
+	scheduler.run();
+}
+
+// Woken from Sleep by the RX line. The byte that woke us is lost, so tell
+// the peer we are listening now (see the wake contract in Gateway.h).
+void rfWoken() {
+	rfWakePending = false;
+	Serial1.write(RF_READY);
+}
+
+void buttonPressed() {
+	if (scheduler.active(windowTask)) { // Already running the display
+		displayOff();
+		delay(100);
+		enableRF();
+		scheduler.start(windowTask, RADIO_TIME);
+	} else {
+		displayOn();
+		drawReadout();
+		screen.compose(layers, 2, &grid);
+		screen.flush();
+		scheduler.start(windowTask, DISPLAY_TIME);
+	}
+}
+
+// Two degrees a pixel, with zero five rows up from the bottom of the grid
+int plotRow(float t) {
+	return (31 - 5) - (int)(t / 2);
+}
+
+// Newest sample on the right, however many there are so far
+void drawPlot() {
+	plot.clear();
+	int x = NUM_TEMPS - temperature.size();
+	for (int i = 0; i < (int)temperature.size() - 1; i++, x++) {
+		plot.drawLine(x, plotRow(temperature[i]), x + 1, plotRow(temperature[i + 1]));
 	}
+}
 
-	enableMemsOsc();
+// Make room for the newest sample and join it to the one before
+void plotSample() {
+	plot.scrollLeft(1);
+	int n = temperature.size();
+	if (n > 1) {
+		plot.drawLine(NUM_TEMPS - 2, plotRow(temperature[n - 2]), NUM_TEMPS - 1, plotRow(temperature[n - 1]));
+	}
+}
+
+// Temperature to two places and the time, as "23.25 C 12:34:56"
+void drawReadout() {
+	char text[24];
+	float t = temperature.empty() ? 0.0 : temperature.newest();
+	char *p = formatFixed(text, (int32_t)(t * 100 + ((t < 0) ? -0.5f : 0.5f)), 2, 4);
+	*p++ = ' ';
+	*p++ = 'C';
+	*p++ = ' ';
+	formatTime(p, RTCTIME);
+	readout.clear();
+	readout.drawText(0, 0, text);
+}
+
+void sampleTask() {
+	if (sampling.running()) {
+		return;
+	}
+	rails.acquire(sensorRail);
+	sampleStep();
+}
+
+// Only the newest sample and the count change, so only they are written.
+bool sampleStep() {
+	static float t;
+
+	CO_BEGIN(sampling);
+	CO_WAIT_UNTIL(sampling, rails.ready(sensorRail));
+	emc.begin();
+	CO_WAIT_UNTIL(sampling, emc.temperatureTask(t));
+	emc.end();
+	temperature.push(t);
+	sampleCount++;
+	plotSample();
+	screen.compose(layers, 2, &grid);
+
+	eeram.begin();
+	CO_WAIT_UNTIL(sampling, eeram.writeTask(temperature.index(temperature.size() - 1) * sizeof(float),
+	                                        (uint8_t *)&temperature.newest(), sizeof(float)));
+	CO_WAIT_UNTIL(sampling, eeram.writeTask(temperature.dataSize(),
+	                                        (uint8_t *)&sampleCount, sizeof(sampleCount)));
+	eeram.end();
+	CO_END(sampling);
+}
 
-	if (wakeReason & SNOOZE) {
-		disableSensorPower();
+#if defined(GATEWAY_MODE)
+void collectTask() {
+	// Skip a round if someone is connected to us
+	if (!rfEnabled) {
+		enableRF();
+		gateway.collect(GATEWAY_SCAN_TIME);
+		peerLogDirty = true;
 		disableRF();
-		sleepMethod = SLEEP;
-		resetPins();
 	}
+}
+#endif
+
+#if defined(ADVERTISE_PERIOD)
+// A freshly booted module advertises, so powering it is enough
+void advertiseTask() {
+	if (!rfEnabled) {
+		enableRF();
+		scheduler.start(windowTask, ADVERTISE_TIME);
+	}
+}
+#endif
 
-	if (wakeReason & SAMPLE) {
-		for (int i = 0; i < NUM_TEMPS - 1; i++) {
-			temperature[i] = temperature[i + 1];
-		}
+// The display or radio window is over. A connected radio is left up
+// until the peer goes away.
+void windowEnd() {
+	if (!rfConnected) {
+		disableRF();
+	}
+	displayOff();
+}
 
-		enableSensorPower();
-		emc.begin();
-		temperature[NUM_TEMPS - 1] = emc.getTemperature();
-		emc.end();
-		saveEERAMData();
+// Light the panel, waking it if its rail has stayed up since it was last
+// set up and bringing it up from scratch otherwise.
+void displayOn() {
+	uint32_t now = scheduler.now();
+	if (displayLastOn != 0) {
+		uint32_t gap = now - displayLastOn;
+		displayGap = (displayGap == 0xFFFFFFFF) ? gap : (displayGap * 3 + gap) / 4;
+	}
+	displayLastOn = now;
 
-		if (sleepMethod == SLEEP) {
-			disableSensorPower();
-			resetPins();
-		}
+	if (displayLit) {
+		return;
 	}
+	// SPI2 has been reset while off, so the port is set up again either way
+	power.enter(displayPeripherals);
+	spiBus.begin();
+	rails.acquire(sensorRail);
+	if (rails.powerCount(sensorRail) == displayPower) {
+		screen.wake();
+	} else {
+		rails.wait(sensorRail);
+		// The driver sets the port up its own way, so the bus has to again
+		oled.initializeDevice();
+		spiBus.reconfigure();
+		screen.begin();
+		displayPower = rails.powerCount(sensorRail);
+	}
+	displayLit = true;
+}
 
-	if (wakeReason & BUTTON) {
-        if (sleepMethod == SNOOZE) { // Already running the display
-            disableSensorPower();
-            resetPins();
-            delay(100);
-            enableRF();
-            startTick(20);
-        } else {   
-    		enableSensorPower();
-    		oled.initializeDevice();
-    		oled.startBuffer();
-    		oled.fillScreen(Color::Black);
-    		RTCCValue t = RTCC.value();
-    		oled.setCursor(0, 0);
-    		oled.printf("%4.2f C %02d:%02d:%02d",
-    		            temperature[NUM_TEMPS - 1],
-    		            t.hours(), t.minutes(), t.seconds()
-    		           );
-    
-    		for (int i = 0; i < NUM_TEMPS; i += 2) {
-    			oled.setPixel(i, 31 - 5, Color::White);
-    		}
-    
-    		for (int i = 0; i < NUM_TEMPS; i += 8) {
-    			for (int j = 0; j < 25; j += 5) {
-    				if (j != 5) {
-    					oled.setPixel(i, 31 - j, Color::White);
-    				}
-    			}
-    		}
-    
-    		for (int i = 0; i < NUM_TEMPS - 1; i++) {
-    			oled.drawLine(i, (31 - 5) - temperature[i] / 2.0, i + 1, (31 - 5) - temperature[i + 1] / 2.0, Color::White);
-    		}
-    
-    		oled.endBuffer();
-    		// The 10 second tick timer must use SNOOZE not SLEEP, otherwise it will have its clock turned off.
-    		sleepMethod = SNOOZE;
-            startTick(5);
-        }
+// Put the panel to sleep. Its rail is held up for the next press only if
+// one is expected soon.
+void displayOff() {
+	if (!displayLit) {
+		return;
 	}
+	displayLit = false;
+	screen.sleep();
+	power.leave(displayPeripherals);
+	rails.release(sensorRail, (displayGap < DISPLAY_WARM_WINDOW) ? DISPLAY_WARM_WINDOW : 0);
 }
 
+void railsExpire() {
+	rails.expire();
+}
 
 void initRTC() {
 	char months[26] = {4, 0, 0, 12, 0, 2, 0, 0, 0, 1, 0, 0, 3, 11, 10, 0, 0, 0, 9, 0, 0, 0, 0, 0, 0, 0};
@@ -213,22 +495,10 @@ void initRTC() {
 	rv.date(year, month, day);
 	rv.setValidity(RTCC_VAL_GCC); // date/time approximated using compilation time: works for developers only!!!
 	RTCC.set(rv);
-	rv.seconds(0);
-	rv.minutes(0);
-	rv.hours(0);
-	RTCC.alarmSet(rv);
-	RTCC.alarmMask(AL_HOUR);
-	RTCC.chimeEnable();
-	RTCC.alarmEnable();
-	RTCC.attachInterrupt(&wake);
-}
-
-void wake() {
-	wakeReason = SAMPLE;
 }
 
 void displayData() {
-	wakeReason = BUTTON;
+	events.post(BUTTON);
 }
 
 void initRF() {
@@ -236,7 +506,7 @@ void initRF() {
 	BLE.begin();
 	BLE.enterCommandMode();
 	BLE.factoryReset();
-	delay(1000);
+	BLE.waitForBoot(1000);
 	BLE.enterCommandMode();
 	BLE.setSerializedDeviceName("DSMini");
 	BLE.setFeatures(RN4871::Feature::NoPrompt);
@@ -248,35 +518,143 @@ void initRF() {
 	BLE.setDISModelName("DSMini");
 	BLE.setDISManufacturer("Majenko Technologies");
 	BLE.setDISSerialNumber("1");
+#if defined(PIN_RF_WAKE)
+	BLE.setLowPower(true);
+#endif
 	BLE.reboot();
-	BLE.enterDataMode();
+	// The module comes back from %REBOOT% in data mode, so there is no
+	// command mode to leave.
+	BLE.waitForBoot(1000);
 	disableRF();
 }
 
 void enableRF() {
-	pinMode(PIN_BLUETOOTH_POWER, OUTPUT);
-	digitalWrite(PIN_BLUETOOTH_POWER, HIGH);
-	delay(1000);
-	LowPower.enableUART2();
-	Serial1.begin(115200);
-//	Serial1.attachInterrupt(Serial1RXInterrupt);
+	uint32_t now = scheduler.now();
+	if (rfLastStart != 0) {
+		uint32_t gap = now - rfLastStart;
+		rfGap = (rfGap == 0xFFFFFFFF) ? gap : (rfGap * 3 + gap) / 4;
+	}
+	rfLastStart = now;
+
+	power.enter(radioPeripherals);
+	// A dormant module has kept its rail
+	rails.acquire(radioRail);
+	if (rfDormant) {
+		Serial1.begin(115200);
+		rfDormant = false;
+		if (!BLE.wake(1000)) {
+			// Fall back to a cold start
+			rails.restart(radioRail);
+			BLE.waitForBoot(1000);
+		}
+	} else {
+		// The module takes tens of ms to boot, so the UART is up long before
+		// it announces itself.
+		Serial1.begin(115200);
+		BLE.waitForBoot(1000);
+	}
+	BLE.attachDMA(bleDMA, &U2TXREG, _UART2_TX_IRQ);
+	rfEnabled = true;
 }
 
 void disableRF() {
-//	Serial1.detachInterrupt();
+	disableRXWake();
+	BLE.detachDMA();
+
+#if defined(PIN_RF_WAKE)
+	// Keep the module dormant if we expect to need it again soon: waking
+	// it is far cheaper than a cold boot.
+	if (rfGap < RF_WARM_WINDOW) {
+		BLE.enterCommandMode();
+		rfDormant = BLE.dormant();
+	}
+#endif
+
 	Serial1.end();
-	LowPower.disableUART2();
-	digitalWrite(PIN_BLUETOOTH_POWER, LOW);
+	power.leave(radioPeripherals);
+	// A dormant module is only worth keeping for the next expected session
+	rails.release(radioRail, rfDormant ? RF_WARM_WINDOW : 0);
+	rfEnabled = false;
+	rfConnected = false;
+}
+
+// Read whatever the module has sent. Status messages are framed by %...%,
+// anything else is data from the peer.
+void handleRF() {
+	static char status[24];
+	static int spos = -1;
+
+	while (Serial1.available()) {
+		int c = Serial1.read();
+		if (c == '%') {
+			if (spos < 0) {
+				spos = 0;
+				continue;
+			}
+			status[spos] = 0;
+			spos = -1;
+			if (!strncmp(status, "CONNECT", 7)) {
+				rfConnected = true;
+				setLinkProfile(RN4871::Idle);
+			} else if (!strncmp(status, "DISCONNECT", 10)) {
+				disableRF();
+				return;
+			}
+			continue;
+		}
+		if (spos >= 0) {
+			if (spos < (int)sizeof(status) - 1) {
+				status[spos++] = c;
+			}
+			continue;
+		}
+		if (c == GATEWAY_HISTORY) {
+			sendHistory();
+		}
+	}
+}
+
+// The module can only change the connection while in command mode.
+void setLinkProfile(const RN4871::ConnectionProfile &p) {
+	BLE.enterCommandMode();
+	BLE.updateConnectionParameters(p);
+	BLE.enterDataMode();
+}
+
+// Dump the temperature history on a short connection interval, then drop
+// back to the idle interval so the link costs little while it waits. The
+// format is described in Gateway.h.
+void sendHistory() {
+	uint16_t count = temperature.size();
+	uint8_t header[6] = {
+		(uint8_t)sampleCount, (uint8_t)(sampleCount >> 8),
+		(uint8_t)(sampleCount >> 16), (uint8_t)(sampleCount >> 24),
+		(uint8_t)count, (uint8_t)(count >> 8)
+	};
+
+	setLinkProfile(RN4871::Burst);
+	BLE.write(header, sizeof(header));
+	float *p;
+	for (size_t i = 0, n; (n = temperature.span(i, p)) > 0; i += n) {
+		BLE.writeAsync((const uint8_t *)p, n * sizeof(float));
+	}
+	BLE.flush();
+	setLinkProfile(RN4871::Idle);
 }
 
+// While asleep the UART is unclocked, so a change on the RX pin catches
+// the start bit of the first incoming byte instead.
+void enableRXWake() {
+	attachWakeSource(_SER1_RX_PIN, WAKE_CHANGE, serialWake);
+}
 
-void enableSensorPower() {
-	pinMode(PIN_SENSOR_POWER, OUTPUT);
-	digitalWrite(PIN_SENSOR_POWER, HIGH);
+void disableRXWake() {
+	detachWakeSource(_SER1_RX_PIN);
 }
 
-void disableSensorPower() {
-	digitalWrite(PIN_SENSOR_POWER, LOW);
+// The module has lost power, dormant or not
+void radioOff() {
+	rfDormant = false;
 }
 
 void disableMemsOsc() {
@@ -291,17 +669,32 @@ void enableMemsOsc() {
 	LowPower.restoreSystemClock();
 }
 
+// The history is kept in EERAM as the ring's raw storage followed by the
+// sample count, from which the position of the newest sample follows.
 void loadEERAMData() {
-	eeram.begin();
-	uint8_t *data = (uint8_t *)temperature;
+	uint32_t magic = 0;
 
-	for (int i = 0; i < (NUM_TEMPS * sizeof(float)); i++) {
-		data[i] = eeram.read(i);
+	eeram.begin();
+	eeram.read(EERAM_MAGIC_ADDRESS, (uint8_t *)&magic, sizeof(magic));
+	if (magic != EERAM_MAGIC) {
+		clearEERAMData();
+		eeram.end();
+		return;
 	}
 
+	eeram.read(0, (uint8_t *)temperature.data(), temperature.dataSize());
+	eeram.read(temperature.dataSize(), (uint8_t *)&sampleCount, sizeof(sampleCount));
+
+#if defined(GATEWAY_MODE)
+	eeram.read(PEERLOG_ADDRESS, (uint8_t *)peerLog.data(), peerLog.dataSize());
+	peerLog.validate();
+#endif
+
 	eeram.end();
 
-	for (int i = 0; i < 96; i++) {
+	temperature.restore(sampleCount % NUM_TEMPS, sampleCount);
+
+	for (size_t i = 0; i < temperature.size(); i++) {
 		if (
 		    isnan(temperature[i]) ||
 		    isinf(temperature[i]) ||
@@ -313,46 +706,59 @@ void loadEERAMData() {
 	}
 }
 
-void saveEERAMData() {
-	eeram.begin();
-	uint8_t *data = (uint8_t *)temperature;
+// Start the EERAM over with an empty history. The magic word goes last
+// so a clear cut short by a power loss is done again next time.
+void clearEERAMData() {
+	uint32_t magic = EERAM_MAGIC;
 
-	for (int i = 0; i < (NUM_TEMPS * sizeof(float)); i++) {
-		eeram.write(i, data[i]);
-	}
+	memset(temperature.data(), 0, temperature.dataSize());
+	temperature.clear();
+	sampleCount = 0;
+	eeram.write(0, (uint8_t *)temperature.data(), temperature.dataSize());
+	eeram.write(temperature.dataSize(), (uint8_t *)&sampleCount, sizeof(sampleCount));
 
-	eeram.end();
-}
+#if defined(GATEWAY_MODE)
+	peerLog.clear();
+	eeram.write(PEERLOG_ADDRESS, (uint8_t *)peerLog.data(), peerLog.dataSize());
+#endif
 
-void startTick(int secs) {
-	LowPower.enableTimer4();
-	T4CON = 0;
-	// F = 32768 internal RC F_CPU (assume we switch to that soon.
-	T4CONbits.TCKPS = 7; // div 256
-	// F = 128Hz prescaled
-	TMR4 = 0;
-	PR4 = 128 * secs; // 128 ticks per second, 10 seconds.
-	setIntPriority(_TIMER_4_VECTOR, 4, 0);
-	setIntVector(_TIMER_4_VECTOR, tickDone);
-	clearIntFlag(_TIMER_4_IRQ);
-	setIntEnable(_TIMER_4_IRQ);
-	// Turn it on.
-	T4CONbits.ON = 1;
+	eeram.write(EERAM_MAGIC_ADDRESS, (uint8_t *)&magic, sizeof(magic));
 }
 
-void __USER_ISR tickDone() {
-	T4CONbits.ON = 0;
-	clearIntEnable(_TIMER_4_IRQ);
-	wakeReason = SNOOZE;
-	LowPower.disableTimer4();
+#if defined(GATEWAY_MODE)
+// The EERAM is on the sensor rail, which is down between samples
+void savePeerLog() {
+	rails.acquire(sensorRail);
+	rails.wait(sensorRail);
+	eeram.begin();
+	eeram.write(PEERLOG_ADDRESS, (uint8_t *)peerLog.data(), peerLog.dataSize());
+	eeram.end();
+	rails.release(sensorRail);
 }
+#endif
 
+// The sensor rail is off. Put every pin in its lowest power state
+// (pinProfileSleep in the variant) with a few port writes, leaving the
+// rail switches, which stay outputs, and the radio's if it is in use.
 void resetPins() {
-	for (int i = 0; i < NUM_DIGITAL_PINS; i++) {
-		pinMode(i, defmodes[i]);
+	uint16_t keep[PIN_PROFILE_PORTS] = { 0 };
+
+	keepPinProfilePin(keep, PIN_SENSOR_POWER);
+	keepPinProfilePin(keep, PIN_BLUETOOTH_POWER);
+	if (rfEnabled || rfDormant) {
+#if defined(PIN_RF_WAKE)
+		keepPinProfilePin(keep, PIN_RF_WAKE);
+#endif
+		keepPinProfilePin(keep, _SER1_RX_PIN);
+		keepPinProfilePin(keep, _SER1_TX_PIN);
 	}
+	applyPinProfile(&pinProfileSleep, keep);
 }
 
-void Serial1RXInterrupt(int c) {
-	wakeReason = SERIAL;
+// Every edge of the first byte lands here, but one wake is one RF_READY
+void serialWake() {
+	if (!rfWakePending) {
+		rfWakePending = true;
+		events.post(SERIAL);
+	}
 }
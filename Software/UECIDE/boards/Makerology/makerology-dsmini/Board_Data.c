@@ -347,6 +347,8 @@ const uint8_t external_int_to_digital_pin_PGM[] = {
 #if	(OPT_BOARD_INIT != 0)
 #endif
 
+#include <wiring.h>
+
 /* ------------------------------------------------------------ */
 /*				Board Customization Functions					*/
 /* ------------------------------------------------------------ */
@@ -602,6 +604,308 @@ int	_board_analogWrite(uint8_t pin, int val) {
 
 #endif
 
+/* ------------------------------------------------------------ */
+/*					Wake Sources								*/
+/* ------------------------------------------------------------ */
+
+#define	_CNCON_ON	0x8000
+#define	_WAKE_INT	0x80		// Flag in _wake_mode: on an external interrupt
+
+static void (*_wake_func[NUM_DIGITAL_PINS])(void);
+static uint8_t _wake_mode[NUM_DIGITAL_PINS];
+
+static const uint8_t _cn_irq[] = {
+	0,
+	_CHANGE_NOTICE_A_IRQ,
+	_CHANGE_NOTICE_B_IRQ,
+	_CHANGE_NOTICE_C_IRQ,
+};
+
+/* ------------------------------------------------------------ */
+/***	_wake_int_number
+**
+**	Parameters:
+**		pin		- digital pin number
+**
+**	Return Value:
+**		The external interrupt wired to the pin, or -1 for none.
+*/
+static int _wake_int_number(uint8_t pin) {
+	int		n;
+
+	if (pin == PIN_INT0) {
+		return 0;
+	}
+	for (n = 1; n < NUM_INT_PINS + 1; n++) {
+		if (external_int_to_digital_pin_PGM[n] == pin) {
+			return n;
+		}
+	}
+	return -1;
+}
+
+/* ------------------------------------------------------------ */
+/***	_wake_cn_isr
+**
+**	Description:
+**		Shared change notice interrupt. Reading each port clears
+**		its mismatch; the handlers for the pins that changed, and
+**		for edge modes changed the right way, are then called.
+*/
+void __USER_ISR _wake_cn_isr(void) {
+	uint8_t		port;
+	uint8_t		pin;
+
+	for (port = _IOPORT_PA; port <= _IOPORT_PC; port++) {
+		p32_ioport *	iop = (p32_ioport *)portRegisters(port);
+		uint32_t		changed = iop->cnstat.reg & iop->cnen.reg;
+		uint32_t		level = iop->port.reg;
+
+		clearIntFlag(_cn_irq[port]);
+		if (changed == 0) {
+			continue;
+		}
+		for (pin = 0; pin < NUM_DIGITAL_PINS; pin++) {
+			uint16_t	mask = digitalPinToBitMask(pin);
+
+			if ((_wake_func[pin] == 0) || (_wake_mode[pin] & _WAKE_INT) ||
+				(digitalPinToPort(pin) != port) || !(changed & mask)) {
+				continue;
+			}
+			if ((_wake_mode[pin] == WAKE_RISING) && !(level & mask)) {
+				continue;
+			}
+			if ((_wake_mode[pin] == WAKE_FALLING) && (level & mask)) {
+				continue;
+			}
+			_wake_func[pin]();
+		}
+	}
+}
+
+/* ------------------------------------------------------------ */
+/***	attachWakeSource
+**
+**	Parameters:
+**		pin		- digital pin number
+**		mode	- WAKE_CHANGE, WAKE_RISING or WAKE_FALLING
+**		func	- called from the interrupt when the pin changes
+**
+**	Return Value:
+**		Returns 0 for a bad pin or mode, !0 on success.
+**
+**	Description:
+**		Make a pin wake the processor. The pin should already be
+**		set up as an input.
+*/
+int attachWakeSource(uint8_t pin, uint8_t mode, void (*func)(void)) {
+	int				n;
+	uint8_t			port;
+	p32_ioport *	iop;
+
+	if ((pin >= NUM_DIGITAL_PINS) || (mode > WAKE_FALLING) || (func == 0)) {
+		return 0;
+	}
+	detachWakeSource(pin);
+
+	n = _wake_int_number(pin);
+	if ((n >= 0) && (mode != WAKE_CHANGE)) {
+		_wake_func[pin] = func;
+		_wake_mode[pin] = mode | _WAKE_INT;
+		attachInterrupt(n, func, (mode == WAKE_RISING) ? RISING : FALLING);
+		return 1;
+	}
+
+	port = digitalPinToPort(pin);
+	iop = (p32_ioport *)portRegisters(port);
+	_wake_func[pin] = func;
+	_wake_mode[pin] = mode;
+
+	iop->cncon.set = _CNCON_ON;
+	iop->cnen.set = digitalPinToBitMask(pin);
+	(void)iop->port.reg;
+
+	setIntVector(_CHANGE_NOTICE_VECTOR, _wake_cn_isr);
+	setIntPriority(_CHANGE_NOTICE_VECTOR, 4, 0);
+	clearIntFlag(_cn_irq[port]);
+	setIntEnable(_cn_irq[port]);
+	return 1;
+}
+
+/* ------------------------------------------------------------ */
+/***	detachWakeSource
+**
+**	Parameters:
+**		pin		- digital pin number
+**
+**	Description:
+**		Stop a pin waking the processor. A port's change notice is
+**		turned off with its last pin.
+*/
+void detachWakeSource(uint8_t pin) {
+	uint8_t			port;
+	p32_ioport *	iop;
+
+	if ((pin >= NUM_DIGITAL_PINS) || (_wake_func[pin] == 0)) {
+		return;
+	}
+
+	if (_wake_mode[pin] & _WAKE_INT) {
+		detachInterrupt(_wake_int_number(pin));
+	} else {
+		port = digitalPinToPort(pin);
+		iop = (p32_ioport *)portRegisters(port);
+		iop->cnen.clr = digitalPinToBitMask(pin);
+		if (iop->cnen.reg == 0) {
+			clearIntEnable(_cn_irq[port]);
+			iop->cncon.clr = _CNCON_ON;
+		}
+	}
+	_wake_func[pin] = 0;
+}
+
+/* ------------------------------------------------------------ */
+/*					Pin Profiles								*/
+/* ------------------------------------------------------------ */
+
+/* The state pinMode() would leave each pin in, worked out by port
+** from the pin tables above:
+**
+**	RA0 RA1							INPUT_PULLDOWN
+**	RB2 RB3 RB5-8 RB10-15			INPUT_PULLDOWN
+**	RB9			(12, button)		INPUT_PULLUP
+**	RB0 RB1		(16, 17, U2)		INPUT
+**	RC0 RC1 RC3						INPUT_PULLDOWN
+*/
+const pin_profile pinProfileSleep = {{
+	//	mask	tris	lat		ansel	cnpu	cnpd
+	{	0x0003,	0x0003,	0x0000,	0x0000,	0x0000,	0x0003	},	// A
+	{	0xFFEF,	0xFFEF,	0x0000,	0x0000,	0x0200,	0xFDEC	},	// B
+	{	0x000B,	0x000B,	0x0000,	0x0000,	0x0000,	0x000B	},	// C
+}};
+
+/* ------------------------------------------------------------ */
+/***	applyPinProfile
+**
+**	Parameters:
+**		profile	- the pin states to put in place
+**		keep	- a mask per port of pins to leave alone, or 0
+**
+**	Description:
+**		Output levels and pulls are set before the directions, so
+**		a pin never drives the wrong way or floats on its way into
+**		the profile.
+*/
+void applyPinProfile(const pin_profile * profile, const uint16_t * keep) {
+	int				i;
+	uint16_t		m;
+	p32_ioport *	iop;
+
+	for (i = 0; i < PIN_PROFILE_PORTS; i++) {
+		const pin_profile_port *	p = &profile->port[i];
+
+		m = p->mask;
+		if (keep != 0) {
+			m &= ~keep[i];
+		}
+		if (m == 0) {
+			continue;
+		}
+		iop = (p32_ioport *)portRegisters(_IOPORT_PA + i);
+
+		iop->lat.clr = m & ~p->lat;
+		iop->lat.set = m & p->lat;
+		iop->cnpu.clr = m & ~p->cnpu;
+		iop->cnpu.set = m & p->cnpu;
+		iop->cnpd.clr = m & ~p->cnpd;
+		iop->cnpd.set = m & p->cnpd;
+		iop->ansel.clr = m & ~p->ansel;
+		iop->ansel.set = m & p->ansel;
+		iop->tris.set = m & p->tris;
+		iop->tris.clr = m & ~p->tris;
+	}
+}
+
+/* ------------------------------------------------------------ */
+/***	savePinProfile
+**
+**	Parameters:
+**		save	- filled in with the current state
+**		profile	- the profile about to be applied
+**
+**	Description:
+**		Record the current state of the pins a profile covers, so
+**		applying the saved profile afterwards leaves it again.
+*/
+void savePinProfile(pin_profile * save, const pin_profile * profile) {
+	int				i;
+	uint16_t		m;
+	p32_ioport *	iop;
+
+	for (i = 0; i < PIN_PROFILE_PORTS; i++) {
+		m = profile->port[i].mask;
+		iop = (p32_ioport *)portRegisters(_IOPORT_PA + i);
+
+		save->port[i].mask = m;
+		save->port[i].tris = iop->tris.reg & m;
+		save->port[i].lat = iop->lat.reg & m;
+		save->port[i].ansel = iop->ansel.reg & m;
+		save->port[i].cnpu = iop->cnpu.reg & m;
+		save->port[i].cnpd = iop->cnpd.reg & m;
+	}
+}
+
+/* ------------------------------------------------------------ */
+/***	keepPinProfilePin
+**
+**	Parameters:
+**		keep	- a mask per port, as taken by applyPinProfile
+**		pin		- digital pin number to add to it
+*/
+void keepPinProfilePin(uint16_t * keep, uint8_t pin) {
+	if (pin >= NUM_DIGITAL_PINS) {
+		return;
+	}
+	keep[digitalPinToPort(pin) - _IOPORT_PA] |= digitalPinToBitMask(pin);
+}
+
+/* ------------------------------------------------------------ */
+/***	checkPinProfile
+**
+**	Parameters:
+**		profile	- a profile meant to cover every pin
+**
+**	Return Value:
+**		-1 if the profile's masks hold exactly the port bits of the
+**		pins in the tables above, else the first pin left out, or
+**		NUM_DIGITAL_PINS if a mask has a bit that is no pin's.
+**
+**	Description:
+**		pinProfileSleep is worked out by hand from the tables, so it
+**		has to be checked against them again when they change.
+*/
+int checkPinProfile(const pin_profile * profile) {
+	uint16_t	seen[PIN_PROFILE_PORTS] = { 0 };
+	uint16_t	m;
+	int			pin;
+	int			i;
+
+	for (pin = 0; pin < NUM_DIGITAL_PINS; pin++) {
+		i = digitalPinToPort(pin) - _IOPORT_PA;
+		m = digitalPinToBitMask(pin);
+		if ((i < 0) || (i >= PIN_PROFILE_PORTS) || !(profile->port[i].mask & m)) {
+			return pin;
+		}
+		seen[i] |= m;
+	}
+	for (i = 0; i < PIN_PROFILE_PORTS; i++) {
+		if (profile->port[i].mask & ~seen[i]) {
+			return NUM_DIGITAL_PINS;
+		}
+	}
+	return -1;
+}
+
 #endif // OPT_BOARD_DATA
 
 /* ------------------------------------------------------------ */
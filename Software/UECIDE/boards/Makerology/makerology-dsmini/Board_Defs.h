@@ -339,6 +339,174 @@ extern const uint8_t	external_int_to_digital_pin_PGM[];
 #define _DTWI0_SCL_PIN  7 
 #define _DTWI0_SDA_PIN  6
 
+/* ------------------------------------------------------------ */
+/*					Wake Source Declarations					*/
+/* ------------------------------------------------------------ */
+
+/* Any pin can be made to wake the processor from Sleep or Idle and
+** call a function when it changes, through its change notice. Edge
+** modes on a pin wired to one of INT0-INT4 use the external interrupt
+** instead. Change notice edges are picked out by reading the pin in
+** the interrupt, so pulses shorter than the wake up can be missed.
+*/
+#define	WAKE_CHANGE		0
+#define	WAKE_RISING		1
+#define	WAKE_FALLING	2
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+int		attachWakeSource(uint8_t pin, uint8_t mode, void (*func)(void));
+void	detachWakeSource(uint8_t pin);
+
+#if defined(__cplusplus)
+}
+#endif
+
+/* ------------------------------------------------------------ */
+/*					Pin Profile Declarations					*/
+/* ------------------------------------------------------------ */
+
+/* A pin profile is the state of a set of pins given as masks for
+** each port, so a whole profile can be put in place with a few
+** SET and CLR register writes instead of a pinMode() per pin.
+** Pins outside a port's mask are left alone, as are PPS output
+** mappings and any PWM running on a pin.
+*/
+#define	PIN_PROFILE_PORTS	3		// Ports A, B and C
+
+typedef struct {
+	uint16_t	mask;		// Pins the profile sets
+	uint16_t	tris;		// Inputs
+	uint16_t	lat;		// Outputs driven high
+	uint16_t	ansel;		// Analog inputs
+	uint16_t	cnpu;		// Pull-ups
+	uint16_t	cnpd;		// Pull-downs
+} pin_profile_port;
+
+typedef struct {
+	pin_profile_port	port[PIN_PROFILE_PORTS];
+} pin_profile;
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/* Every pin an input, pulled down except for the button, which is
+** pulled up, and the Bluetooth UART, which the module drives.
+*/
+extern const pin_profile	pinProfileSleep;
+
+void	applyPinProfile(const pin_profile * profile, const uint16_t * keep);
+void	savePinProfile(pin_profile * save, const pin_profile * profile);
+void	keepPinProfilePin(uint16_t * keep, uint8_t pin);
+int		checkPinProfile(const pin_profile * profile);
+
+#if defined(__cplusplus)
+}
+#endif
+
+/* ------------------------------------------------------------ */
+/*					Fast Digital I/O Declarations				*/
+/* ------------------------------------------------------------ */
+
+/* For a pin number known when compiling, FastPin<pin> resolves
+** the port and bit then and there, so each call is a single
+** store to LATxSET, LATxCLR or LATxINV (or a load of PORTx)
+** instead of the table lookups in digitalWrite(). Only the
+** latch is touched: the pin must already be set up, and any
+** PWM on it stopped. Pins known only at run time still go
+** through digitalWrite() and the tables.
+**
+**		FastPin<PIN_SENSOR_POWER>::high();
+**		fastDigitalWrite<PIN_BLUETOOTH_POWER>(LOW);
+*/
+#if defined(__cplusplus)
+
+#include <p32xxxx.h>
+#include <p32_defs.h>
+
+#define	_FAST_PORT(P)											\
+	struct _FastPort##P {										\
+		static inline void set(uint32_t m) { LAT##P##SET = m; }	\
+		static inline void clr(uint32_t m) { LAT##P##CLR = m; }	\
+		static inline void inv(uint32_t m) { LAT##P##INV = m; }	\
+		static inline uint32_t get() { return PORT##P; }		\
+	}
+
+_FAST_PORT(A);
+_FAST_PORT(B);
+_FAST_PORT(C);
+
+// Left undefined, so an unknown pin fails to compile
+template <uint8_t pin> struct FastPin;
+
+#define	_FAST_PIN(N, P, B)										\
+	template <> struct FastPin<N> {								\
+		static const uint8_t port = _IOPORT_P##P;				\
+		static const uint32_t mask = 1 << B;					\
+		static inline void high() { _FastPort##P::set(mask); }	\
+		static inline void low() { _FastPort##P::clr(mask); }	\
+		static inline void toggle() { _FastPort##P::inv(mask); }	\
+		static inline void write(uint8_t v) { if (v) { high(); } else { low(); } }	\
+		static inline int read() { return (_FastPort##P::get() & mask) ? 1 : 0; }	\
+	}
+
+_FAST_PIN( 0, A,  0);	// AN
+_FAST_PIN( 1, B, 12);	// RES
+_FAST_PIN( 2, B, 10);	// CS
+_FAST_PIN( 3, B, 15);	// SCK2
+_FAST_PIN( 4, B, 13);	// SDI2
+_FAST_PIN( 5, B, 11);	// SDO2
+_FAST_PIN( 6, B,  2);	// SDA2
+_FAST_PIN( 7, B,  3);	// SCL2
+_FAST_PIN( 8, C,  0);	// U1TX
+_FAST_PIN( 9, C,  1);	// U1RX
+_FAST_PIN(10, B,  7);	// INT0
+_FAST_PIN(11, B,  8);	// PWM
+_FAST_PIN(12, B,  9);	// Button
+_FAST_PIN(13, C,  3);	// LED
+_FAST_PIN(14, A,  1);	// SENSECTL
+_FAST_PIN(15, B, 14);	// RFCTL
+_FAST_PIN(16, B,  1);	// U2RX
+_FAST_PIN(17, B,  0);	// U2TX
+_FAST_PIN(18, B,  5);	// PGD
+_FAST_PIN(19, B,  6);	// PGC
+
+template <uint8_t pin> static inline void fastDigitalWrite(uint8_t val) {
+	FastPin<pin>::write(val);
+}
+
+template <uint8_t pin> static inline int fastDigitalRead() {
+	return FastPin<pin>::read();
+}
+
+/* The table above is a hand copy of the pin tables, which stay
+** the reference. checkFastPins() compares the two and returns
+** the first pin that differs, or -1 if they agree.
+*/
+template <uint8_t pin> struct _FastPinCheck {
+	static inline int first() {
+		int p = _FastPinCheck<(uint8_t)(pin - 1)>::first();
+		if (p >= 0) {
+			return p;
+		}
+		return ((FastPin<pin>::port == digital_pin_to_port_PGM[pin]) &&
+				(FastPin<pin>::mask == digital_pin_to_bit_mask_PGM[pin])) ? -1 : pin;
+	}
+};
+
+template <> struct _FastPinCheck<255> {
+	static inline int first() { return -1; }
+};
+
+static inline int checkFastPins() {
+	return _FastPinCheck<NUM_DIGITAL_PINS - 1>::first();
+}
+
+#endif	// __cplusplus
+
 /* ------------------------------------------------------------ */
 /*					A/D Converter Declarations					*/
 /* ------------------------------------------------------------ */